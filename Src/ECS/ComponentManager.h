@@ -148,6 +148,7 @@ protected:
 
 protected:
 	std::map< ComponentId, ComponentPool > m_pools;
+	std::mutex m_poolsMutex; // systems register their component types from whichever thread constructs them
 	Entity m_nextFreeEntityId;
 	std::size_t m_entityCount;
 
@@ -233,6 +234,7 @@ struct NameComponent : public Component<NameComponent>
 template<typename T>
 void ComponentManager::addComponentType(std::size_t reserve)
 {
+	std::lock_guard<std::mutex> l(m_poolsMutex);
 	CHECK_F(m_pools.find(T::componentId()) == m_pools.end());
 	ComponentPool& pool = m_pools.insert(std::make_pair(T::componentId(), ComponentPool())).first->second;
 	pool.m_accessor = &ComponentPool::BufferAccessorInstance<T>::s_instance;
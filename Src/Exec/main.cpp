@@ -2,6 +2,8 @@
 #include <vld.h>
 #include <Windows.h>
 #include "../Threading/ThreadPool.h"
+#include "../Threading/Bootstrap.h"
+#include "../Threading/MainThreadQueue.h"
 #include "../imgui/ImGuiManager.h"
 #include "../Managers/TimeManager.h"
 #include "../Misc/Misc.h"
@@ -10,6 +12,7 @@
 #include "../Rendering/Texture.h"
 #include "../Files/FileManager.h"
 #include "../Files/File.h"
+#include "../Files/DerivedCache.h"
 #include "../Sprites/SpriteData.h"
 #include "../Rendering/RenderingDevice.h"
 #include "../Rendering/TextureAtlas.h"
@@ -48,6 +51,7 @@
 #include "../Tools/Standalone.h"
 #include "../Tools/SystemTray.h"
 #include "../Game/TicTacToe.h"
+#include "../Tools/AssetCooker.h"
 
 //#define STANDALONE_TOOLS
 //#define SYSTEMTRAY_TOOLS
@@ -71,6 +75,11 @@ static void tests(std::function<void(float)>& update, std::function<void()>& ren
 	//tests->addTest("WindowRecorder", &WindowRecorder::test);
 	//tests->addTest("WebServer", &WebServer::test);
 	//tests->addTest("SpriteSystem", &SpriteSystem::test);
+	tests->addTest("SpriteBatching", &SpriteSystem::benchmark);
+	tests->addTest("SpriteFrames", &SpriteSystem::benchmarkFrames);
+	tests->addTest("SpriteGeneration", &SpriteSystem::testGeneration);
+	tests->addTest("SpriteSampler", &SpriteData::testSampler);
+	tests->addTest("UnitRecording", &Rendering::Unit::testRecording);
 	tests->addTest("ModelSystem", &ModelSystem::test);
 	tests->addTest("Game", &Game::test);
 	//tests->startTest("Game");
@@ -91,6 +100,10 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
 	loguru::init(__argc, __argv);
 	initLoggingForVisualStudio("App.log");
 
+	// offline asset cooking, no window or device
+	if (__argc > 1 && strcmp(__argv[1], "--cook") == 0)
+		return AssetCooker::main(__argc - 1, __argv + 1);
+
 	VulkanFramework::AppType type = VulkanFramework::AppType::MainWindow;
 #ifdef STANDALONE_TOOLS
 	type = VulkanFramework::AppType::ImGuiOnly;
@@ -101,10 +114,35 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
 #endif
 
 	ResourceManager r; r.init();
-	ResourcePtr<VulkanFramework> vf; vf->init(type);
+
+	// the window and device stay on this thread, everything else is built on the pool as soon as what it needs exists
+	Bootstrap boot;
+	boot.addSingleton<EventManager>("EventManager", {});
+	boot.addSingleton<TimeManager>("TimeManager", {});
+	boot.addSingleton<MainThreadQueue>("MainThreadQueue", { "EventManager" });
+	boot.addSingleton<FileManager>("FileManager", { "EventManager" }, Bootstrap::MainThread); // the watcher's completions are APCs to this thread, only the main thread waits alertably
+	boot.addSingleton<DerivedCache>("DerivedCache", {});
+	boot.addSingleton<ScriptManager>("ScriptManager", { "EventManager" });
+	boot.addSingleton<InputManager>("InputManager", { "EventManager" });
+	boot.addSingleton<ImGuiManager>("ImGuiManager", { "EventManager", "FileManager" });
+	boot.add("VulkanFramework", { "EventManager", "TimeManager", "InputManager", "ImGuiManager" }, [type]() { ResourcePtr<VulkanFramework>()->init(type); }, Bootstrap::MainThread);
+	boot.addSingleton<Rendering::Device>("Device", { "VulkanFramework" }, Bootstrap::MainThread);
+	boot.addSingleton<ComponentManager>("ComponentManager", { "EventManager", "ScriptManager" });
+	boot.addSingleton<TransformSystem>("TransformSystem", { "ComponentManager" });
+	boot.addSingleton<CameraSystem>("CameraSystem", { "ComponentManager", "EventManager" });
+	boot.addSingleton<PhysicsSystem>("PhysicsSystem", { "ComponentManager", "EventManager" });
+	boot.addSingleton<SpriteSystem>("SpriteSystem", { "ComponentManager", "Device" }, Bootstrap::MainThread);
+	boot.addSingleton<AssetBrowser>("AssetBrowser", { "FileManager" });
+	boot.addSingleton<TicTacToeSystem>("TicTacToeSystem", { "ComponentManager", "TransformSystem", "CameraSystem", "PhysicsSystem", "SpriteSystem" });
+	boot.run();
+	boot.report();
+
+	ResourcePtr<VulkanFramework> vf;
 	ResourcePtr<ScriptManager> sm;
 	ResourcePtr<TimeManager> t;
 	ResourcePtr<FileManager> f;
+	ResourcePtr<DerivedCache> dc;
+	ResourcePtr<MainThreadQueue> mtq;
 	ResourcePtr<ImGuiManager> m;
 	ResourcePtr<EventManager> em;
 	ResourcePtr<ComponentManager> cm;
@@ -122,6 +160,9 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
 	WindowRecorder recorder;
 	
 	r.setFreeResources(false);
+	r.setMemoryBudget("Texture", 64 * 1024 * 1024, 256 * 1024 * 1024);
+	r.setMemoryBudget("Sprite Data", 4 * 1024 * 1024, 0);
+	r.setMemoryBudget("File", 32 * 1024 * 1024, 0);
 	em->addListener<ImGuiRenderEvent>([&r](ImGuiRenderEvent*) { r.imgui(); });
 	em->addListener<ImGuiRenderEvent>([m](ImGuiRenderEvent*) { bool* b = m->win("Demo"); if (*b) ImGui::ShowDemoWindow(b); });
 	em->addListener<ImGuiRenderEvent>([m](ImGuiRenderEvent*) { m->drawMainMenuBar(); m->drawFramerate(); m->drawTrayContext(); });
@@ -133,12 +174,21 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
 	em->addListener<ImGuiRenderEvent>([s](ImGuiRenderEvent*) { s->imgui(); });
 	//em->addListener<ImGuiRenderEvent>([g](ImGuiRenderEvent*) { g->imgui(); });
 	em->addListener<ImGuiRenderEvent>([ab](ImGuiRenderEvent*) { ab->imgui(); });
+	em->addListener<ImGuiRenderEvent>([dc](ImGuiRenderEvent*) { dc->imgui(); });
+	em->addListener<ImGuiRenderEvent>([f](ImGuiRenderEvent*) { f->imgui(); });
+	em->addListener<ImGuiRenderEvent>([mtq](ImGuiRenderEvent*) { mtq->imgui(); });
 	em->addListener<ImGuiRenderEvent>([&recorder](ImGuiRenderEvent*) { recorder.imgui(); });
+	em->addListener<ImGuiRenderEvent>([&boot](ImGuiRenderEvent*) { boot.imgui(); });
 	em->addListener<ImGuiRenderEvent>([](ImGuiRenderEvent*) { Meta::Object::imgui(); });
 
 	//TileLevel level;
 	//em->addListener<ImGuiRenderEvent>([level](ImGuiRenderEvent*) { level->imgui(); });	
 
+	r.registerPrefetchType<File>("File");
+	r.registerPrefetchBatch("File", [f](const std::vector<std::string>& paths) { f->prefetch(paths); }); // read on the I/O threads, the File loaders take the mappings
+	r.registerPrefetchType<Rendering::Texture>("Texture");
+	r.useWarmList("warmlist.txt");
+
 	r.startLoading();
 	r.setAutoStartTasks(true);
 
@@ -200,7 +250,7 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
 
 		em->process(update->m_delta);
 
-		r.freeUnreferenced(); // should call this less often
+		r.collect(1.0f);
 		r.startReloading();
 	}
 
@@ -24,10 +24,13 @@
 #include <array>
 #include <set>
 #include <list>
+#include <deque>
 #include <forward_list>
 #include <stack>
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <atomic>
 #include <fstream>
 #include <sstream>
 #include <filesystem>
@@ -0,0 +1,249 @@
+#include "stdafx.h"
+#include "Archive.h"
+#include "../Misc/Misc.h"
+#include "xxhash/xxhash.h"
+#include "Fossilize/miniz/miniz.h"
+
+static const XXH64_hash_t s_seed = 0x6a756e6b70696c65;
+
+static std::uint64_t alignUp(std::uint64_t value, std::uint64_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+bool Archive::open(StringView path, std::string* error)
+{
+	CHECK_F(m_content == nullptr);
+	m_path = path.str();
+	if (!m_file.open(m_path, 0, error))
+		return false;
+
+	if (m_file.getSize() < sizeof(Header))
+	{
+		*error = stringf("\"%s\" is too small to be an archive", m_path.c_str());
+		return false;
+	}
+	m_content = m_file.getContent();
+	m_size = m_file.getSize();
+
+	const Header* header = (const Header*)m_content;
+	if (header->m_magic != Magic || header->m_version != Version)
+	{
+		*error = stringf("\"%s\" isn't a version %d archive", m_path.c_str(), Version);
+		return false;
+	}
+
+	std::uint64_t indexSize = (std::uint64_t)header->m_bucketCount * sizeof(Entry);
+	bool powerOfTwo = header->m_bucketCount > 0 && (header->m_bucketCount & (header->m_bucketCount - 1)) == 0;
+	if (!powerOfTwo || sizeof(Header) + indexSize > header->m_namesOffset || header->m_namesOffset + header->m_namesSize > m_size)
+	{
+		*error = stringf("\"%s\" has a corrupt index", m_path.c_str());
+		return false;
+	}
+
+	// only the index is checked up front, entries are checked when they're read
+	const char* index = m_content + sizeof(Header);
+	if (XXH64(index, (std::size_t)(header->m_namesOffset + header->m_namesSize - sizeof(Header)), s_seed) != header->m_indexHash)
+	{
+		*error = stringf("\"%s\" failed its index checksum", m_path.c_str());
+		return false;
+	}
+
+	// entries are read in whatever order they're asked for, reading ahead past one only wastes the page cache
+	MappedFile::advise(m_content + header->m_namesOffset + header->m_namesSize, m_size - (std::size_t)(header->m_namesOffset + header->m_namesSize), MappedFile::Advice::Random);
+
+	m_header = header;
+	m_entries = (const Entry*)index;
+	m_names = m_content + header->m_namesOffset;
+	return true;
+}
+
+std::uint64_t Archive::hashName(StringView name)
+{
+	std::uint64_t hash = XXH64(name.c_str(), name.size(), s_seed);
+	return hash != 0 ? hash : 1; // 0 marks an empty bucket
+}
+
+const Archive::Entry* Archive::find(StringView name) const
+{
+	if (!m_header)
+		return nullptr;
+
+	std::uint64_t hash = hashName(name);
+	std::uint32_t mask = m_header->m_bucketCount - 1;
+	for (std::uint32_t i = (std::uint32_t)hash & mask;; i = (i + 1) & mask)
+	{
+		const Entry& entry = m_entries[i];
+		if (entry.m_pathHash == 0)
+			return nullptr;
+
+		if (entry.m_pathHash == hash && getName(entry) == name)
+			return &entry;
+	}
+}
+
+StringView Archive::getName(const Entry& entry) const
+{
+	return StringView(m_names + entry.m_nameOffset, m_names + entry.m_nameOffset + entry.m_nameLength);
+}
+
+StringView Archive::getStored(const Entry& entry) const
+{
+	return StringView(m_content + entry.m_offset, m_content + entry.m_offset + entry.m_storedSize);
+}
+
+std::size_t Archive::getEntryCount() const
+{
+	return m_header ? m_header->m_entryCount : 0;
+}
+
+bool Archive::read(const Entry& entry, std::vector<char>* decompressed, std::string* error) const
+{
+	if (entry.m_offset + entry.m_storedSize > m_size)
+	{
+		*error = stringf("\"%s\" in \"%s\" is out of bounds", getName(entry).str().c_str(), m_path.c_str());
+		return false;
+	}
+
+	StringView stored = getStored(entry);
+	if (XXH64(stored.c_str(), stored.size(), s_seed) != entry.m_dataHash)
+	{
+		*error = stringf("\"%s\" in \"%s\" failed its checksum", getName(entry).str().c_str(), m_path.c_str());
+		return false;
+	}
+
+	if ((entry.m_flags & Compressed) == 0)
+		return true;
+
+	decompressed->resize((std::size_t)entry.m_size);
+	mz_ulong size = (mz_ulong)entry.m_size;
+	if (mz_uncompress((unsigned char*)decompressed->data(), &size, (const unsigned char*)stored.c_str(), (mz_ulong)stored.size()) != MZ_OK || size != entry.m_size)
+	{
+		*error = stringf("\"%s\" in \"%s\" failed to decompress", getName(entry).str().c_str(), m_path.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool Archive::write(StringView path, const std::vector<Source>& sources, int flags, std::uint32_t alignment)
+{
+	CHECK_F(alignment > 0 && (alignment & (alignment - 1)) == 0, "Archive alignment must be a power of two");
+
+	std::uint32_t bucketCount = 16;
+	while (bucketCount < sources.size() * 2)
+		bucketCount *= 2;
+
+	// names go right after the index, so the data offsets are known before anything is read
+	std::vector<Entry> index(bucketCount);
+	memset(index.data(), 0, index.size() * sizeof(Entry));
+	std::vector<std::uint32_t> buckets;
+	std::string names;
+	for (const Source& source : sources)
+	{
+		std::uint64_t hash = hashName(source.m_name);
+		std::uint32_t i = (std::uint32_t)hash & (bucketCount - 1);
+		for (; index[i].m_pathHash != 0; i = (i + 1) & (bucketCount - 1))
+		{
+			if (index[i].m_pathHash == hash && names.compare(index[i].m_nameOffset, index[i].m_nameLength, source.m_name) == 0)
+			{
+				LOG_F(ERROR, "\"%s\" is in the archive twice\n", source.m_name.c_str());
+				return false;
+			}
+		}
+
+		Entry& entry = index[i];
+		entry.m_pathHash = hash;
+		entry.m_nameOffset = (std::uint32_t)names.size();
+		entry.m_nameLength = (std::uint32_t)source.m_name.size();
+		names += source.m_name;
+		buckets.push_back(i);
+	}
+
+	std::string tempPath = path.str() + ".tmp";
+	std::fstream f(tempPath, std::fstream::binary | std::fstream::out | std::fstream::trunc);
+	if (!f.is_open())
+	{
+		LOG_F(ERROR, "Unable to write archive \"%s\"\n", tempPath.c_str());
+		return false;
+	}
+
+	Header header = {};
+	header.m_magic = Magic;
+	header.m_version = Version;
+	header.m_entryCount = (std::uint32_t)sources.size();
+	header.m_bucketCount = bucketCount;
+	header.m_alignment = alignment;
+	header.m_namesOffset = sizeof(Header) + bucketCount * sizeof(Entry);
+	header.m_namesSize = names.size();
+
+	std::uint64_t offset = alignUp(header.m_namesOffset + header.m_namesSize, alignment);
+	std::vector<char> compressed;
+	for (std::size_t s = 0; s < sources.size(); s++)
+	{
+		const Source& source = sources[s];
+		Entry& entry = index[buckets[s]];
+
+		std::ifstream in(source.m_path, std::ios_base::binary);
+		if (!in.is_open())
+		{
+			LOG_F(ERROR, "Unable to read \"%s\" for the archive\n", source.m_path.c_str());
+			return false;
+		}
+		std::vector<char> contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+		WIN32_FILE_ATTRIBUTE_DATA attributes;
+		if (GetFileAttributesExA(source.m_path.c_str(), GetFileExInfoStandard, &attributes))
+			entry.m_modificationTime = ULARGE_INTEGER{ attributes.ftLastWriteTime.dwLowDateTime, attributes.ftLastWriteTime.dwHighDateTime }.QuadPart;
+
+		const std::vector<char>* stored = &contents;
+		if ((flags & Compress) && !contents.empty())
+		{
+			mz_ulong size = mz_compressBound((mz_ulong)contents.size());
+			compressed.resize(size);
+			if (mz_compress2((unsigned char*)compressed.data(), &size, (const unsigned char*)contents.data(), (mz_ulong)contents.size(), MZ_BEST_SPEED) == MZ_OK && size < contents.size() - contents.size() / 8)
+			{
+				compressed.resize(size);
+				stored = &compressed;
+				entry.m_flags |= Compressed;
+			}
+		}
+
+		entry.m_offset = offset;
+		entry.m_storedSize = stored->size();
+		entry.m_size = contents.size();
+		entry.m_dataHash = XXH64(stored->data(), stored->size(), s_seed);
+
+		f.seekp(offset);
+		f.write(stored->data(), stored->size());
+		offset = alignUp(offset + stored->size(), alignment);
+	}
+
+	// extend the file to the aligned end of the last entry
+	f.seekp(offset - 1);
+	f.put(0);
+
+	std::vector<char> indexAndNames(index.size() * sizeof(Entry) + names.size());
+	memcpy(indexAndNames.data(), index.data(), index.size() * sizeof(Entry));
+	memcpy(indexAndNames.data() + index.size() * sizeof(Entry), names.data(), names.size());
+	header.m_indexHash = XXH64(indexAndNames.data(), indexAndNames.size(), s_seed);
+
+	f.seekp(0);
+	f.write((const char*)&header, sizeof(header));
+	f.write(indexAndNames.data(), indexAndNames.size());
+	f.close();
+	if (!f.good())
+	{
+		LOG_F(ERROR, "Failed to write archive \"%s\"\n", tempPath.c_str());
+		return false;
+	}
+
+	// readers never see a half written archive
+	if (!MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		LOG_F(ERROR, "MoveFileEx failed \"%s\" (%X)\n", path.c_str(), GetLastError());
+		return false;
+	}
+
+	LOG_F(INFO, "Wrote %d entries to \"%s\" (%s)\n", (int)sources.size(), path.c_str(), prettySize((std::size_t)offset).c_str());
+	return true;
+}
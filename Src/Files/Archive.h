@@ -0,0 +1,82 @@
+#pragma once
+
+#include "../Misc/StringView.h"
+#include "MappedFile.h"
+
+// read only pack of assets, mapped once and looked up through a hashed index.
+// Layout: Header, Entry[m_bucketCount] (open addressing, m_pathHash 0 = empty), names, then every entry's data aligned to m_alignment
+class Archive
+{
+public:
+	static const std::uint32_t Magic = 0x4B41504A; // "JPAK" on disk
+	static const std::uint32_t Version = 1;
+
+	enum EntryFlags
+	{
+		Compressed = 1 // deflated with miniz, decompressed into the File on load
+	};
+
+	struct Header
+	{
+		std::uint32_t m_magic;
+		std::uint32_t m_version;
+		std::uint32_t m_entryCount;
+		std::uint32_t m_bucketCount; // power of two
+		std::uint32_t m_alignment;
+		std::uint32_t m_padding;
+		std::uint64_t m_namesOffset;
+		std::uint64_t m_namesSize;
+		std::uint64_t m_indexHash; // xxHash of the index and names
+	};
+
+	struct Entry
+	{
+		std::uint64_t m_pathHash;
+		std::uint64_t m_offset;
+		std::uint64_t m_storedSize;
+		std::uint64_t m_size;
+		std::uint64_t m_dataHash; // xxHash of the stored bytes
+		std::int64_t m_modificationTime;
+		std::uint32_t m_nameOffset, m_nameLength;
+		std::uint32_t m_flags;
+		std::uint32_t m_padding;
+	};
+
+	struct Source
+	{
+		std::string m_name; // path relative to the search path, ie. "Sprites/player.png"
+		std::string m_path; // file to read it from
+	};
+
+	enum WriteFlags
+	{
+		Compress = 1 // entries that shrink by at least an eighth are stored compressed
+	};
+
+public:
+	Archive() = default;
+	Archive(const Archive&) = delete;
+
+	bool open(StringView path, std::string* error);
+
+	const Entry* find(StringView name) const;
+	StringView getName(const Entry&) const;
+	StringView getStored(const Entry&) const; // raw bytes, compressed or not
+	bool read(const Entry&, std::vector<char>* decompressed, std::string* error) const; // verifies the hash and decompresses
+
+	const std::string& getPath() const { return m_path; }
+	std::size_t getEntryCount() const;
+
+	static bool write(StringView path, const std::vector<Source>&, int flags, std::uint32_t alignment = 16);
+	static std::uint64_t hashName(StringView);
+
+protected:
+	std::string m_path;
+	MappedFile m_file;
+	const char* m_content{ nullptr };
+	std::size_t m_size{ 0 };
+
+	const Header* m_header{ nullptr };
+	const Entry* m_entries{ nullptr };
+	const char* m_names{ nullptr };
+};
@@ -0,0 +1,170 @@
+#include "stdafx.h"
+#include "CookedAsset.h"
+#include "../Rendering/TextureAtlas.h"
+#include "../Sprites/SpriteData.h"
+#include "../Misc/Misc.h"
+#include "xxhash/xxhash.h"
+
+template<typename T>
+static void append(std::vector<char>* out, const T& value)
+{
+	const char* bytes = (const char*)&value;
+	out->insert(out->end(), bytes, bytes + sizeof(T));
+}
+
+static void appendHeader(std::vector<char>* out, CookedAsset::Type type, StringView source)
+{
+	CookedAsset::Header header = {};
+	header.m_magic = CookedAsset::Magic;
+	header.m_version = CookedAsset::Version;
+	header.m_type = type;
+	header.m_sourceHash = CookedAsset::hashSource(source);
+	append(out, header);
+}
+
+const void* CookedAsset::read(StringView contents, Type type, std::size_t payloadSize)
+{
+	if (contents.size() < sizeof(Header) + payloadSize)
+		return nullptr;
+
+	const Header* header = (const Header*)contents.c_str();
+	if (header->m_magic != Magic || header->m_version != Version || header->m_type != type)
+		return nullptr;
+
+	return header + 1;
+}
+
+std::uint64_t CookedAsset::hashSource(StringView contents)
+{
+	return XXH64(contents.c_str(), contents.size(), Version);
+}
+
+bool CookedAsset::cookTexture(StringView source, std::vector<char>* out)
+{
+	unsigned char* pixels;
+	unsigned int width, height;
+	if (lodepng_decode32(&pixels, &width, &height, (const unsigned char*)source.c_str(), source.size()) != 0)
+		return false;
+
+	writeTexture(source, width, height, 4, (const char*)pixels, out);
+	free(pixels);
+	return true;
+}
+
+void CookedAsset::writeTexture(StringView source, int width, int height, int pixelSize, const char* texels, std::vector<char>* out)
+{
+	Texture texture = {};
+	texture.m_width = width;
+	texture.m_height = height;
+	texture.m_pixelSize = pixelSize;
+
+	appendHeader(out, Type::Texture, source);
+	append(out, texture);
+	out->insert(out->end(), texels, texels + (std::size_t)width * height * pixelSize);
+}
+
+bool CookedAsset::cookSprite(StringView source, std::vector<char>* out)
+{
+	const int pixelSize = 4;
+	const unsigned int padding = 2;
+
+	int width = 0, height = 0;
+	std::vector<SpriteFrame> frames;
+	std::vector<char> texels;
+	SpriteData::decodeGif(source, [&](int w, int h, float duration, const char* rgba) {
+		SpriteFrame frame = {};
+		frame.m_time = frames.empty() ? 0.0f : frames.back().m_time + frames.back().m_duration;
+		frame.m_duration = duration;
+		frames.push_back(frame);
+
+		width = w, height = h;
+		texels.insert(texels.end(), rgba, rgba + w * h * pixelSize);
+	});
+
+	if (frames.empty())
+		return false;
+
+	// same packing as TextureAtlas::layoutAtlas, done once here instead of on every load
+	int atlasWidth, atlasHeight;
+	std::vector<glm::ivec4> rects;
+	Rendering::TextureAtlas::pack(std::vector<glm::ivec2>(frames.size(), glm::ivec2(width, height)), padding, &atlasWidth, &atlasHeight, &rects);
+
+	std::vector<char> atlas((std::size_t)atlasWidth * atlasHeight * pixelSize, 0);
+	BitBltBuffer d = { atlas.data(), (std::size_t)pixelSize, atlasWidth, atlasHeight };
+	for (std::size_t i = 0; i < frames.size(); i++)
+	{
+		BitBltBuffer s = { texels.data() + i * width * height * pixelSize, (std::size_t)pixelSize, width, height };
+		const glm::ivec4& rect = rects[i];
+		bitblt(d, rect.x + padding / 2, rect.y + padding / 2, rect.z - (int)padding, rect.w - (int)padding, s, 0, 0);
+
+		frames[i].m_uv1[0] = (float)rect.x / (float)atlasWidth;
+		frames[i].m_uv1[1] = (float)rect.y / (float)atlasHeight;
+		frames[i].m_uv2[0] = (float)(rect.x + rect.z) / atlasWidth;
+		frames[i].m_uv2[1] = (float)(rect.y + rect.w) / (float)atlasHeight;
+	}
+
+	Sprite sprite = {};
+	sprite.m_frameCount = (std::uint32_t)frames.size();
+	sprite.m_width = width;
+	sprite.m_height = height;
+	sprite.m_pixelSize = pixelSize;
+	sprite.m_atlasWidth = atlasWidth;
+	sprite.m_atlasHeight = atlasHeight;
+	sprite.m_atlasPadding = padding;
+
+	appendHeader(out, Type::Sprite, source);
+	append(out, sprite);
+	for (const SpriteFrame& frame : frames)
+		append(out, frame);
+	out->insert(out->end(), texels.begin(), texels.end());
+	out->insert(out->end(), atlas.begin(), atlas.end());
+	return true;
+}
+
+bool CookedAsset::cookMesh(StringView source, std::vector<char>* out)
+{
+	typedef MeshVertex Vert;
+	ofbx::IScene* scene = ofbx::load((ofbx::u8*)source.c_str(), (int)source.size(), (ofbx::u64)ofbx::LoadFlags::TRIANGULATE);
+	if (!scene || scene->getMeshCount() == 0)
+	{
+		if (scene)
+			scene->destroy();
+		return false;
+	}
+
+	const ofbx::Geometry* geo = scene->getMesh(0)->getGeometry();
+	const ofbx::Vec3* positions = geo->getVertices();
+	const ofbx::Vec2* uvs = geo->getUVs();
+	const int* face = geo->getFaceIndices();
+
+	// one vertex per face corner (negative indices end a polygon), then identical vertices are welded behind an index buffer
+	std::vector<Vert> vertices;
+	std::vector<std::uint32_t> indices;
+	std::unordered_map<std::string, std::uint32_t> welded;
+	for (int i = 0; i < geo->getIndexCount(); i++)
+	{
+		int posIndex = (face[i] < 0 ? (-face[i]) - 1 : face[i]);
+		Vert vert;
+		vert.m_position[0] = (float)positions[posIndex].x;
+		vert.m_position[1] = (float)positions[posIndex].y;
+		vert.m_position[2] = (float)positions[posIndex].z;
+		vert.m_uv[0] = uvs ? (float)uvs[i].x : 0.0f;
+		vert.m_uv[1] = uvs ? 1.0f - (float)uvs[i].y : 0.0f;
+
+		auto it = welded.emplace(std::string((const char*)&vert, sizeof(vert)), (std::uint32_t)vertices.size());
+		if (it.second)
+			vertices.push_back(vert);
+		indices.push_back(it.first->second);
+	}
+	scene->destroy();
+
+	Mesh mesh = {};
+	mesh.m_vertexCount = (std::uint32_t)vertices.size();
+	mesh.m_indexCount = (std::uint32_t)indices.size();
+
+	appendHeader(out, Type::Mesh, source);
+	append(out, mesh);
+	out->insert(out->end(), (const char*)vertices.data(), (const char*)(vertices.data() + vertices.size()));
+	out->insert(out->end(), (const char*)indices.data(), (const char*)(indices.data() + indices.size()));
+	return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "../Misc/StringView.h"
+
+// pre-decoded assets written by AssetCooker, stored in the archive under the source's name.
+// Loaders check for the header and copy straight into their buffers, anything else is decoded like before
+struct CookedAsset
+{
+	static const std::uint32_t Magic = 0x444B434A; // "JCKD" on disk
+	static const std::uint32_t Version = 1; // bump when a layout changes, everything gets cooked again
+
+	enum class Type : std::uint32_t
+	{
+		Texture = 1,
+		Sprite = 2,
+		Mesh = 3
+	};
+
+	struct Header
+	{
+		std::uint32_t m_magic;
+		std::uint32_t m_version;
+		Type m_type;
+		std::uint32_t m_padding;
+		std::uint64_t m_sourceHash; // see hashSource(), unchanged sources aren't cooked again
+	};
+
+	// followed by m_width * m_height * m_pixelSize texels
+	struct Texture
+	{
+		std::uint32_t m_width, m_height, m_pixelSize;
+		std::uint32_t m_padding;
+	};
+
+	// followed by SpriteFrame[m_frameCount], every frame's texels, then the atlas texels
+	struct Sprite
+	{
+		std::uint32_t m_frameCount;
+		std::uint32_t m_width, m_height, m_pixelSize;
+		std::uint32_t m_atlasWidth, m_atlasHeight, m_atlasPadding;
+		std::uint32_t m_padding;
+	};
+
+	struct SpriteFrame
+	{
+		float m_time, m_duration;
+		float m_uv1[2], m_uv2[2]; // in the atlas
+	};
+
+	// followed by MeshVertex[m_vertexCount] then std::uint32_t[m_indexCount]
+	struct Mesh
+	{
+		std::uint32_t m_vertexCount, m_indexCount;
+	};
+
+	struct MeshVertex
+	{
+		float m_position[3];
+		float m_uv[2];
+	};
+
+	// the payload (Texture, Sprite or Mesh) if contents is a cooked asset of this type and version, and at least payloadSize long
+	static const void* read(StringView contents, Type, std::size_t payloadSize);
+	static std::uint64_t hashSource(StringView contents);
+
+	// decode a source into a blob, used by AssetCooker and by loaders filling the DerivedCache. false if it doesn't decode
+	static bool cookTexture(StringView png, std::vector<char>* out);
+	static bool cookSprite(StringView gif, std::vector<char>* out);
+	static bool cookMesh(StringView fbx, std::vector<char>* out);
+	static void writeTexture(StringView source, int width, int height, int pixelSize, const char* texels, std::vector<char>* out);
+};
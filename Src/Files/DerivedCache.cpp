@@ -0,0 +1,276 @@
+#include "stdafx.h"
+#include "DerivedCache.h"
+#include "../imgui/ImGuiManager.h"
+#include "../Misc/Misc.h"
+#include "xxhash/xxhash.h"
+
+static const XXH64_hash_t s_seed = 0x64657269766564ULL;
+
+static std::int64_t now()
+{
+	FILETIME fileTime;
+	GetSystemTimeAsFileTime(&fileTime);
+	return ULARGE_INTEGER{ fileTime.dwLowDateTime, fileTime.dwHighDateTime }.QuadPart;
+}
+
+DerivedCache::DerivedCache(StringView directory, std::size_t budget):
+m_directory(directory.str()),
+m_budget(budget)
+{
+	if (!CreateDirectoryA(m_directory.c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS)
+		LOG_F(ERROR, "CreateDirectoryA failed \"%s\" (%X)\n", m_directory.c_str(), GetLastError());
+
+	// the index lives in memory only, rebuilt from the file names and write times
+	std::vector<std::string> deletes;
+	WIN32_FIND_DATAA data;
+	HANDLE hFind = FindFirstFileA((m_directory + "*").c_str(), &data);
+	if (hFind != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				continue;
+
+			std::string name = data.cFileName;
+			if (!endsWith(name, ".bin", 4) || name.size() != 16 + 4)
+			{
+				deletes.push_back(m_directory + name); // temp files from a crash
+				continue;
+			}
+
+			Entry entry;
+			entry.m_size = (std::size_t)ULARGE_INTEGER{ data.nFileSizeLow, data.nFileSizeHigh }.QuadPart;
+			entry.m_lastUsed = ULARGE_INTEGER{ data.ftLastWriteTime.dwLowDateTime, data.ftLastWriteTime.dwHighDateTime }.QuadPart;
+			m_entries[strtoull(name.c_str(), nullptr, 16)] = entry;
+			m_size += entry.m_size;
+		} while (FindNextFileA(hFind, &data));
+		FindClose(hFind);
+	}
+
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		trimLocked(&deletes);
+	}
+	remove(deletes);
+
+	LOG_F(INFO, "Derived cache \"%s\": %d entries (%s)\n", m_directory.c_str(), (int)m_entries.size(), prettySize(m_size).c_str());
+}
+
+DerivedCache::Key DerivedCache::key(StringView kind, std::uint32_t version, StringView input, StringView parameters)
+{
+	XXH64_state_t state;
+	XXH64_reset(&state, s_seed);
+	XXH64_update(&state, kind.c_str(), kind.size() + 1); // terminator keeps "ab"+"c" from matching "a"+"bc"
+	XXH64_update(&state, &version, sizeof(version));
+	std::uint64_t inputSize = input.size();
+	XXH64_update(&state, &inputSize, sizeof(inputSize));
+	XXH64_update(&state, input.c_str(), input.size());
+	XXH64_update(&state, parameters.c_str(), parameters.size());
+	return { XXH64_digest(&state) };
+}
+
+std::string DerivedCache::getPath(Key key) const
+{
+	return m_directory + stringf("%016llx.bin", (unsigned long long)key.m_hash);
+}
+
+bool DerivedCache::get(Key key, std::vector<char>* data)
+{
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (m_entries.find(key.m_hash) == m_entries.end())
+		{
+			m_stats.m_misses++;
+			return false;
+		}
+	}
+
+	std::string path = getPath(key);
+	HANDLE hFile = CreateFileA(path.c_str(), GENERIC_READ | FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	bool valid = false;
+	if (hFile != INVALID_HANDLE_VALUE)
+	{
+		Header header;
+		DWORD read = 0;
+		if (ReadFile(hFile, &header, sizeof(header), &read, nullptr) && read == sizeof(header) && header.m_magic == Magic && header.m_key == key.m_hash)
+		{
+			data->resize((std::size_t)header.m_size);
+			valid = data->empty() || (ReadFile(hFile, data->data(), (DWORD)data->size(), &read, nullptr) && read == data->size());
+			valid = valid && XXH64(data->data(), data->size(), s_seed) == header.m_dataHash;
+		}
+
+		// hits keep it from being trimmed, this run and the next
+		FILETIME used;
+		std::int64_t time = now();
+		used.dwLowDateTime = (DWORD)time;
+		used.dwHighDateTime = (DWORD)(time >> 32);
+		if (valid)
+			SetFileTime(hFile, nullptr, nullptr, &used);
+		CloseHandle(hFile);
+	}
+
+	std::lock_guard<std::mutex> l(m_mutex);
+	auto it = m_entries.find(key.m_hash);
+	if (!valid)
+	{
+		LOG_F(WARNING, "Derived cache entry \"%s\" is missing or corrupt\n", path.c_str());
+		if (it != m_entries.end())
+		{
+			m_size -= it->second.m_size;
+			m_entries.erase(it);
+		}
+		m_stats.m_corrupt++;
+		m_stats.m_misses++;
+		DeleteFileA(path.c_str());
+		return false;
+	}
+
+	if (it != m_entries.end())
+		it->second.m_lastUsed = now();
+	m_stats.m_hits++;
+	m_stats.m_bytesRead += data->size();
+	return true;
+}
+
+bool DerivedCache::put(Key key, StringView data)
+{
+	Header header = {};
+	header.m_magic = Magic;
+	header.m_key = key.m_hash;
+	header.m_size = data.size();
+	header.m_dataHash = XXH64(data.c_str(), data.size(), s_seed);
+
+	// unique per put so two threads filling the same key don't write into each other
+	std::string path = getPath(key);
+	std::string tempPath = path + stringf(".%u.tmp", m_nextTemp++);
+	{
+		std::ofstream f(tempPath, std::ios_base::binary | std::ios_base::trunc);
+		f.write((const char*)&header, sizeof(header));
+		f.write(data.c_str(), data.size());
+		if (!f.good())
+		{
+			LOG_F(ERROR, "Unable to write derived cache entry \"%s\"\n", tempPath.c_str());
+			f.close();
+			DeleteFileA(tempPath.c_str());
+			return false;
+		}
+	}
+
+	if (!MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		LOG_F(ERROR, "MoveFileEx failed \"%s\" (%X)\n", path.c_str(), GetLastError());
+		DeleteFileA(tempPath.c_str());
+		return false;
+	}
+
+	std::vector<std::string> deletes;
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		Entry& entry = m_entries[key.m_hash];
+		m_size += sizeof(header) + data.size() - entry.m_size; // 0 if it's new
+		entry.m_size = sizeof(header) + data.size();
+		entry.m_lastUsed = now();
+		m_stats.m_writes++;
+		m_stats.m_bytesWritten += entry.m_size;
+		trimLocked(&deletes);
+	}
+	remove(deletes);
+	return true;
+}
+
+void DerivedCache::setBudget(std::size_t bytes)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	m_budget = bytes;
+}
+
+void DerivedCache::trim()
+{
+	std::vector<std::string> deletes;
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		trimLocked(&deletes);
+	}
+	remove(deletes);
+}
+
+void DerivedCache::trimLocked(std::vector<std::string>* deletes)
+{
+	// m_mutex must be locked
+	if (m_size <= m_budget)
+		return;
+
+	std::vector<std::pair<std::int64_t, std::uint64_t>> byAge;
+	for (auto& entry : m_entries)
+		byAge.emplace_back(entry.second.m_lastUsed, entry.first);
+	std::sort(byAge.begin(), byAge.end());
+
+	// down to 90% so it doesn't trim again on the next put
+	std::size_t target = m_budget - m_budget / 10;
+	for (auto& old : byAge)
+	{
+		if (m_size <= target)
+			break;
+
+		auto it = m_entries.find(old.second);
+		m_size -= it->second.m_size;
+		m_entries.erase(it);
+		m_stats.m_evictions++;
+		deletes->push_back(getPath({ old.second }));
+	}
+}
+
+void DerivedCache::remove(const std::vector<std::string>& paths) const
+{
+	for (const std::string& path : paths)
+	{
+		if (!DeleteFileA(path.c_str()) && GetLastError() != ERROR_FILE_NOT_FOUND)
+			LOG_F(WARNING, "DeleteFileA failed \"%s\" (%X)\n", path.c_str(), GetLastError());
+	}
+}
+
+void DerivedCache::clear()
+{
+	std::vector<std::string> deletes;
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		for (auto& entry : m_entries)
+			deletes.push_back(getPath({ entry.first }));
+		m_stats.m_evictions += (int)m_entries.size();
+		m_entries.clear();
+		m_size = 0;
+	}
+	remove(deletes);
+}
+
+DerivedCache::Stats DerivedCache::getStats() const
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	Stats stats = m_stats;
+	stats.m_entries = m_entries.size();
+	stats.m_size = m_size;
+	return stats;
+}
+
+void DerivedCache::imgui()
+{
+	ResourcePtr<ImGuiManager> im;
+	bool* opened = im->win("Derived Cache");
+	if (*opened == false)
+		return;
+
+	using namespace ImGui;
+	if (Begin("Derived Cache", opened))
+	{
+		Stats stats = getStats();
+		int lookups = stats.m_hits + stats.m_misses;
+		Text("%s", m_directory.c_str());
+		Text("%d entries, %s of %s", (int)stats.m_entries, prettySize(stats.m_size).c_str(), prettySize(m_budget).c_str());
+		Text("Hits: %d Misses: %d (%.1f%% hit rate)", stats.m_hits, stats.m_misses, lookups ? 100.0f * stats.m_hits / lookups : 0.0f);
+		Text("Writes: %d Evictions: %d Corrupt: %d", stats.m_writes, stats.m_evictions, stats.m_corrupt);
+		Text("Read: %s Written: %s", prettySize(stats.m_bytesRead).c_str(), prettySize(stats.m_bytesWritten).c_str());
+		if (Button("Clear"))
+			clear();
+	}
+	End();
+}
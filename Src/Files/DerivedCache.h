@@ -0,0 +1,69 @@
+#pragma once
+
+#include "../Resources/ResourceManager.h"
+
+// persistent cache of data derived from assets (SPIR-V, decoded textures, packed atlases, welded meshes).
+// Entries are addressed by a hash of everything that went into them, so a stale entry is never found, only evicted
+class DerivedCache : public SingletonResource<DerivedCache>
+{
+public:
+	struct Key
+	{
+		std::uint64_t m_hash;
+	};
+
+	struct Stats
+	{
+		int m_hits{ 0 }, m_misses{ 0 }, m_writes{ 0 }, m_evictions{ 0 }, m_corrupt{ 0 };
+		std::size_t m_bytesRead{ 0 }, m_bytesWritten{ 0 };
+		std::size_t m_entries{ 0 }, m_size{ 0 };
+	};
+
+public:
+	DerivedCache(StringView directory = "../Cache/", std::size_t budget = 256 * 1024 * 1024);
+
+	// kind names the processing step ("spirv", "mesh"...), bump version whenever its code changes the output
+	static Key key(StringView kind, std::uint32_t version, StringView input, StringView parameters = StringView(""));
+
+	bool get(Key, std::vector<char>* data); // false on a miss
+	bool put(Key, StringView data); // written to a temp file and renamed, readers never see half an entry
+
+	void setBudget(std::size_t bytes); // least recently used entries are deleted past this
+	void trim();
+	void clear();
+
+	Stats getStats() const;
+	void imgui();
+
+protected:
+	static const std::uint32_t Magic = 0x4344444A; // "JDDC" on disk
+
+	struct Header
+	{
+		std::uint32_t m_magic;
+		std::uint32_t m_padding;
+		std::uint64_t m_key;
+		std::uint64_t m_size;
+		std::uint64_t m_dataHash;
+	};
+
+	struct Entry
+	{
+		std::size_t m_size; // on disk, header included
+		std::int64_t m_lastUsed; // FILETIME, the file's write time is bumped on every hit so it survives restarts
+	};
+
+	std::string getPath(Key) const;
+	void trimLocked(std::vector<std::string>* deletes);
+	void remove(const std::vector<std::string>& paths) const;
+
+protected:
+	std::string m_directory;
+	std::size_t m_budget;
+
+	mutable std::mutex m_mutex;
+	std::unordered_map<std::uint64_t, Entry> m_entries;
+	std::size_t m_size{ 0 };
+	Stats m_stats;
+	std::atomic<unsigned int> m_nextTemp{ 0 };
+};
@@ -2,42 +2,38 @@
 #include <time.h>
 #include "File.h"
 #include "FileManager.h"
+#include "Archive.h"
+#include "MappedFile.h"
+#include "FilePrefetcher.h"
 #include "../Misc/Misc.h"
 
-File::File(StringView path, HANDLE hFile, HANDLE hMapping, void* content):
-m_path(path.str())
+File::File(StringView path, std::unique_ptr<MappedFile> mapping):
+m_path(path.str()),
+m_modificationTime(mapping->getModificationTime()),
+m_size(mapping->getSize()),
+m_content(mapping->getContent(), mapping->getContent() + mapping->getSize()),
+m_mapping(std::move(mapping))
 {
-	CHECK_F(path.c_str() != nullptr && hFile != INVALID_HANDLE_VALUE && hMapping != INVALID_HANDLE_VALUE && content);
 
-	LARGE_INTEGER size;
-	if (!GetFileSizeEx(hFile, &size))
-		LOG_F(ERROR, "GetFileSizeEx failed \"%s\" (%X)\n", path.c_str(), GetLastError());
-
-	static_assert(sizeof(m_size) == sizeof(size), "");
-	m_size = size.QuadPart;
-
-	FILETIME fileTime;
-	if (!GetFileTime(hFile, nullptr, nullptr, &fileTime))
-		LOG_F(ERROR, "GetFileTime failed \"%s\" (%X)\n", path.c_str(), GetLastError());
+}
 
-	static_assert(sizeof(fileTime) == sizeof(m_modificationTime), "");
-	memcpy_s(&m_modificationTime, sizeof(m_modificationTime), &fileTime, sizeof(fileTime));
+File::File(StringView path, std::shared_ptr<const Archive> archive, StringView content, std::int64_t modificationTime, std::vector<char>&& decompressed):
+m_path(path.str()),
+m_modificationTime(modificationTime),
+m_archive(std::move(archive)),
+m_decompressed(std::move(decompressed))
+{
+	if (m_decompressed.empty())
+		m_content = content;
+	else
+		m_content = { m_decompressed.data(), m_decompressed.data() + m_decompressed.size() };
 
-	m_hFile = hFile;
-	m_hMapping = hMapping;
-	m_content = { static_cast<char*>(content), static_cast<char*>(content) + m_size };
+	m_size = m_content.size();
 }
 
 File::~File()
 {
-	if(!UnmapViewOfFile(m_content))
-		LOG_F(ERROR, "UnmapViewOfFile failed \"%s\" %X", m_path.c_str(), GetLastError());
-
-	if (!CloseHandle(m_hMapping))
-		LOG_F(ERROR, "CloseHandle failed \"%s\" %X", m_path.c_str(), GetLastError());
-
-	if (!CloseHandle(m_hFile))
-		LOG_F(ERROR, "CloseHandle failed \"%s\" %X", m_path.c_str(), GetLastError());
+	// m_mapping unmaps loose files, the archive unmaps once the last file using it is gone
 }
 
 std::int64_t File::getModificationTime() const
@@ -50,6 +46,11 @@ std::size_t File::getSize() const
 	return m_size;
 }
 
+std::size_t File::getCpuSize() const
+{
+	return m_size; // mapped, but it's resident once read
+}
+
 StringView File::getContents() const
 {
 	return m_content;
@@ -60,50 +61,99 @@ const std::string& File::getPath() const
 	return m_path;
 }
 
+bool File::isArchived() const
+{
+	return m_archive != nullptr;
+}
+
+void File::prefetch(std::size_t offset, std::size_t size) const
+{
+	if (!m_decompressed.empty() || offset >= m_size)
+		return; // already in memory
+
+	MappedFile::advise(m_content.c_str() + offset, std::min(size, m_size - offset), MappedFile::Advice::WillNeed);
+}
+
 File::FileLoader::FileLoader(StringView path, int flags) : m_path(path.str()), m_flags(flags) {}
 Resource* File::FileLoader::load(std::tuple<int, std::string>* error)
 {
-	std::string path = m_fileManager->resolvePath(m_path.c_str());
-	if (path.empty() && (m_flags & File::CreateIfDoesNotExist) == 0)
+	bool create = (m_flags & File::CreateIfDoesNotExist) != 0;
+
+	// read ahead by FileManager::prefetch()
+	std::unique_ptr<MappedFile> prefetched;
+	if (!create && m_fileManager->getPrefetcher().take(m_path, &prefetched))
 	{
-		*error = { FileNotFound, stringf("\"%s\" not found", m_path.c_str()) };
-		return nullptr;
+		File* file = new File(m_path, std::move(prefetched));
+		addBytesRead(file->getSize());
+		return file;
 	}
 
-	DWORD flags = (m_flags & File::CreateIfDoesNotExist) ? CREATE_NEW : OPEN_EXISTING;
-	HANDLE hFile = CreateFileA(path.c_str(), GENERIC_READ, 0, nullptr, flags, FILE_ATTRIBUTE_NORMAL, nullptr);
-	if (hFile == INVALID_HANDLE_VALUE)
+	// loose files override archives while developing, so edits show up without repacking
+	bool looseFirst = create || m_fileManager->getLooseFileOverride();
+	std::string path;
+	if (looseFirst)
+		path = m_fileManager->resolvePath(m_path.c_str(), false);
+
+	if (path.empty() && !create)
 	{
-		if (GetLastError() == ERROR_FILE_EXISTS)
-			hFile = CreateFileA(path.c_str(), GENERIC_READ, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (File* file = loadArchived(error))
+			return file;
+		if (std::get<int>(*error) != 0)
+			return nullptr;
 
-		if (hFile == INVALID_HANDLE_VALUE)
-		{
-			auto error2 = GetLastError();
+		// not packed, ie. saved at runtime
+		if (!looseFirst)
+			path = m_fileManager->resolvePath(m_path.c_str(), false);
 
-			LOG_F(ERROR, "%s %X\n", m_path.c_str(), error2);
-			*error = { SystemError, stringf("CreateFileA failed \"%s\" (%X)", m_path.c_str(), GetLastError()) };
+		if (path.empty())
+		{
+			LOG_F(WARNING, "File not found: %s\n", m_path.c_str());
+			*error = { FileNotFound, stringf("\"%s\" not found", m_path.c_str()) };
 			return nullptr;
 		}
 	}
 
-	HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
-	if (hMapping == INVALID_HANDLE_VALUE)
+	// loaders read files front to back
+	std::unique_ptr<MappedFile> mapping(new MappedFile);
+	std::string message;
+	if (!mapping->open(path, MappedFile::Sequential | (create ? MappedFile::Create : 0), &message))
 	{
-		CloseHandle(hFile);
-		*error = { SystemError, stringf("CreateFileMapping failed \"%s\" (%X)", m_path.c_str(), GetLastError()) };
+		LOG_F(ERROR, "%s\n", message.c_str());
+		*error = { SystemError, message };
 		return nullptr;
 	}
 
-	void* m = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
-	if (!m)
+	File* file = new File(m_path.c_str(), std::move(mapping));
+	if (file->getSize() >= PrefetchThreshold)
+		file->prefetch();
+
+	addBytesRead(file->getSize());
+	return file;
+}
+
+File* File::FileLoader::loadArchived(std::tuple<int, std::string>* error)
+{
+	const Archive::Entry* entry = nullptr;
+	std::shared_ptr<const Archive> archive = m_fileManager->findArchived(m_path, &entry);
+	if (!archive)
+		return nullptr;
+
+	// read() hashes every stored byte, have the OS read ahead of it
+	StringView stored = archive->getStored(*entry);
+	if (stored.size() >= PrefetchThreshold)
+		MappedFile::advise(stored.c_str(), stored.size(), MappedFile::Advice::WillNeed);
+
+	std::vector<char> decompressed;
+	std::string message;
+	if (!archive->read(*entry, &decompressed, &message))
 	{
-		CloseHandle(hMapping);
-		CloseHandle(hFile);
-		*error = { SystemError, stringf("MapViewOfFile failed \"%s\" (%X)", m_path.c_str(), GetLastError()) };
+		*error = { SystemError, message };
 		return nullptr;
 	}
-	return new File(m_path.c_str(), hFile, hMapping, m);
+
+	File* file = new File(m_path, archive, archive->getStored(*entry), entry->m_modificationTime, std::move(decompressed));
+	addBytesRead((std::size_t)entry->m_storedSize);
+	return file;
 }
 
 // Probably don't need this because files are locked
@@ -121,9 +171,15 @@ std::string File::FileLoader::getDebugName() const
 }
 
 StringView File::FileLoader::getTypeName() const { return "File"; }
+std::string File::FileLoader::getPrefetchKey() const { return m_flags == 0 ? m_path : std::string(); }
 File::FileLoader* File::createLoader(StringView path, int flags) { return new FileLoader(path, flags); }
 
 std::tuple<bool, std::size_t> File::getSharedHash(StringView path, int flags)
 {
-	return{ true, std::hash<std::string>{}(path) };
+	return{ true, StringId::hash(path) };
+}
+
+std::tuple<bool, std::size_t> File::getSharedHash(StringId path, int flags)
+{
+	return{ true, path.getHash() };
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "../Misc/Callbacks.h"
 #include "../Misc/StringView.h"
+#include "../Misc/StringId.h"
 #include "../Resources/ResourceManager.h"
 
 struct FileImpl
@@ -10,13 +11,16 @@ struct FileImpl
 };
 
 class FileManager;
+class Archive;
+class MappedFile;
 class File : public Resource
 {
 public:
 	static const int CreateIfDoesNotExist = 1;
 
 public:
-	File(StringView path, HANDLE hFile, HANDLE hMapping, void* content);
+	File(StringView path, std::unique_ptr<MappedFile>);
+	File(StringView path, std::shared_ptr<const Archive>, StringView content, std::int64_t modificationTime, std::vector<char>&& decompressed); // view into a mounted archive
 	~File();
 
 	std::int64_t getModificationTime() const;
@@ -24,6 +28,15 @@ public:
 	StringView getContents() const;
 
 	const std::string& getPath() const;
+	bool isArchived() const;
+
+	// asks the OS to start reading the range in, so decoding overlaps the reads instead of faulting page by page
+	void prefetch(std::size_t offset = 0, std::size_t size = std::size_t(-1)) const; // the rest of the file by default
+
+	bool canFreeAsync() const override { return true; } // only unmaps and closes handles
+
+	static const std::size_t PrefetchThreshold = 256 * 1024; // larger files are prefetched as soon as they're mapped
+	std::size_t getCpuSize() const override;
 
 	class FileLoader : public Loader
 	{
@@ -33,6 +46,10 @@ public:
 		//Reloader* createReloader() override;
 		std::string getDebugName() const;
 		StringView getTypeName() const;
+		std::string getPrefetchKey() const override;
+
+	protected:
+		File* loadArchived(std::tuple<int, std::string>* error);
 
 	protected:
 		int m_flags;
@@ -41,6 +58,7 @@ public:
 	};
 	static FileLoader* createLoader(StringView path, int flags = 0);
 	static std::tuple<bool, std::size_t> getSharedHash(StringView path, int flags = 0);
+	static std::tuple<bool, std::size_t> getSharedHash(StringId path, int flags = 0); // same hash, already computed
 
 protected:
 	std::string m_path;
@@ -48,5 +66,7 @@ protected:
 	std::size_t m_size;
 	StringView m_content;
 	
-	HANDLE m_hFile, m_hMapping;
+	std::unique_ptr<MappedFile> m_mapping; // loose files
+	std::shared_ptr<const Archive> m_archive; // keeps the mapping alive
+	std::vector<char> m_decompressed; // only for compressed entries
 };
\ No newline at end of file
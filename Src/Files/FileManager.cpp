@@ -1,9 +1,11 @@
 #include "stdafx.h"
 #include <shlwapi.h>
 #include "FileManager.h"
+#include "FilePrefetcher.h"
 #include "../Misc/Misc.h"
 #include "../Managers/TimeManager.h"
 #include "../Threading/ThreadPool.h"
+#include "../imgui/ImGuiManager.h"
 
 FileManager::FileManager():
 m_lastFileChange(0)
@@ -12,6 +14,12 @@ m_lastFileChange(0)
 	addPath("../Res/");
 
 	m_fileWatcher.addWatch(L"../Res/", this, true);
+	m_watched.emplace_back("../Res/");
+
+	if (exists("../Res/assets.jpak"))
+		mountArchive("../Res/assets.jpak");
+
+	m_prefetcher.reset(new FilePrefetcher(this));
 
 	ResourcePtr<EventManager> events;
 	events->addListener<UpdateEvent>([this](UpdateEvent*) { update(); }, 10);
@@ -19,7 +27,7 @@ m_lastFileChange(0)
 
 FileManager::~FileManager()
 {
-	
+	m_prefetcher.reset(); // its threads use the search paths and archives
 }
 
 void FileManager::addPath(const char* path)
@@ -36,6 +44,8 @@ void FileManager::removePath(const char* path)
 void FileManager::update()
 {
 	m_fileWatcher.update();
+	m_prefetcher->update();
+
 	if (!m_bufferedFileChanges.empty())
 	{
 		ResourcePtr<TimeManager> t;
@@ -60,28 +70,96 @@ bool FileManager::exists(const char* path) const
 
 std::int64_t FileManager::getModificationTime(StringView path) const
 {
-	HANDLE hFile = CreateFileA(path.c_str(), 0, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-	if (hFile == INVALID_HANDLE_VALUE)
+	Metadata m = metadata(path);
+	if (m.m_type == Type::NotFound)
 	{
-		LOG_F(ERROR, stringf("CreateFile failed \"%s\"\n", path.c_str()).c_str());
+		LOG_F(ERROR, "GetFileAttributesEx failed \"%s\"\n", path.c_str());
 		return -1;
 	}
+	return m.m_modificationTime;
+}
 
-	FILETIME fileTime;
-	if (!GetFileTime(hFile, nullptr, nullptr, &fileTime))
+FileManager::Type FileManager::type(StringView path) const
+{
+	return metadata(path).m_type;
+}
+
+FileManager::Metadata FileManager::metadata(StringView path) const
+{
+	StringId key = StringId::path(path);
+	bool watched = isWatched(key.str());
+	std::uint64_t generation = 0;
+	if (watched)
 	{
-		LOG_F(ERROR, stringf("GetFileTime failed \"%s\"\n", path.c_str()).c_str());
-		CloseHandle(hFile);
-		return -1;
+		std::lock_guard<std::mutex> l(m_cacheMutex);
+		auto it = m_metadata.find(key);
+		if (it != m_metadata.end())
+		{
+			m_cacheStats.m_hits++;
+			return it->second;
+		}
+		m_cacheStats.m_misses++;
+		generation = m_cacheGeneration;
+	}
+
+	// one call for both, the file doesn't have to be opened
+	Metadata m = { Type::NotFound, -1 };
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attributes))
+	{
+		m.m_type = type(attributes.dwFileAttributes);
+		m.m_modificationTime = ULARGE_INTEGER{ attributes.ftLastWriteTime.dwLowDateTime, attributes.ftLastWriteTime.dwHighDateTime }.QuadPart;
+	}
+
+	if (watched)
+	{
+		std::lock_guard<std::mutex> l(m_cacheMutex);
+		if (generation == m_cacheGeneration)
+			m_metadata[key] = m;
 	}
+	return m;
+}
 
-	CloseHandle(hFile);
-	return ULARGE_INTEGER{ fileTime.dwLowDateTime, fileTime.dwHighDateTime }.QuadPart;
+bool FileManager::isWatched(const std::string& path) const
+{
+	// anything else could change without us hearing about it
+	for (const std::string& watched : m_watched)
+	{
+		if (path.compare(0, watched.size(), watched) == 0 && path.find("/../", watched.size() - 1) == std::string::npos)
+			return true;
+	}
+	return false;
 }
 
-FileManager::Type FileManager::type(StringView path) const
+void FileManager::invalidate(StringView p)
 {
-	return type(GetFileAttributesA(path));
+	std::string path = p.str();
+	normalizePath(path);
+
+	// the path itself, everything under it if it was a directory, and the listing it shows up in
+	std::string parent = path.substr(0, path.find_last_of('/') + 1);
+	std::string prefix = path + '/';
+	auto stale = [&](const std::string& key) {
+		return key == path || key.compare(0, prefix.size(), prefix) == 0;
+	};
+
+	std::lock_guard<std::mutex> l(m_cacheMutex);
+	m_cacheStats.m_invalidations++;
+	m_cacheGeneration++;
+	for (auto it = m_metadata.begin(); it != m_metadata.end();)
+		it = stale(it->first.str()) ? m_metadata.erase(it) : std::next(it);
+
+	for (auto it = m_listings.begin(); it != m_listings.end();)
+		it = (it->first == parent || it->first == prefix || stale(it->first)) ? m_listings.erase(it) : std::next(it);
+}
+
+FileManager::CacheStats FileManager::getCacheStats() const
+{
+	std::lock_guard<std::mutex> l(m_cacheMutex);
+	CacheStats stats = m_cacheStats;
+	stats.m_entries = m_metadata.size();
+	stats.m_listings = m_listings.size();
+	return stats;
 }
 
 FileManager::Type FileManager::type(DWORD attr) const
@@ -104,6 +182,22 @@ std::vector<FileManager::FileInfo> FileManager::files(const char* dir) const
 	if(path[path.size() - 1] != '/')
 		path.append(1, '/');
 
+	normalizePath(path);
+	bool watched = isWatched(path);
+	std::uint64_t generation = 0;
+	if (watched)
+	{
+		std::lock_guard<std::mutex> l(m_cacheMutex);
+		auto it = m_listings.find(path);
+		if (it != m_listings.end())
+		{
+			m_cacheStats.m_hits++;
+			return it->second;
+		}
+		m_cacheStats.m_misses++;
+		generation = m_cacheGeneration;
+	}
+
 	WIN32_FIND_DATAA data;
 	HANDLE hFind = FindFirstFileA((path + "*").c_str(), &data);
 	if (hFind == INVALID_HANDLE_VALUE)
@@ -128,6 +222,12 @@ std::vector<FileManager::FileInfo> FileManager::files(const char* dir) const
 		while (FindNextFileA(hFind, &data));
 		FindClose(hFind);
 
+		if (watched)
+		{
+			std::lock_guard<std::mutex> l(m_cacheMutex);
+			if (generation == m_cacheGeneration)
+				m_listings[path] = r;
+		}
 		return std::move(r);
 	}
 }
@@ -180,11 +280,15 @@ void FileManager::save(const char* path, std::vector<char>&& buffer)
 {
 	std::string p = path;
 	std::vector<char>* contents = new std::vector<char>(std::move(buffer));
-	auto save = [contents, p](){
+	auto save = [this, contents, p](){
 		std::fstream f(p, std::fstream::binary | std::fstream::out | std::fstream::trunc);
 		f.write(&contents->front(), contents->size());
 		LOG_IF_F(WARNING, !f.good(), "Failed to write to \"%s\"\n", p.c_str());
 		delete contents;
+
+		// don't wait for the watcher, whoever saved it might look it up right away
+		f.close();
+		invalidate(p);
 	};
 	m_threadPool->enqueue(save);
 	CHECK_F(buffer.empty());
@@ -202,6 +306,7 @@ void FileManager::handleFileAction(FW::WatchID watchid, const FW::String& dir, c
 	}
 
 	LOG_F(1, "file %s: %S %S\n", actionStr, dir.c_str(), filename.c_str());
+	invalidate(toUtf8(dir + filename));
 
 	FileChange* fileChange = nullptr;
 	auto changeIt = std::find_if(m_bufferedFileChanges.begin(), m_bufferedFileChanges.end(), [&](const FileChange& f) { return f.m_file == filename; });
@@ -222,7 +327,80 @@ void FileManager::handleFileAction(FW::WatchID watchid, const FW::String& dir, c
 	m_lastFileChange = fileChange->m_time;
 }
 
-std::string FileManager::resolvePath(const char* path) const
+bool FileManager::mountArchive(StringView path)
+{
+	auto archive = std::make_shared<Archive>();
+	std::string error;
+	if (!archive->open(path, &error))
+	{
+		LOG_F(ERROR, "Unable to mount archive: %s\n", error.c_str());
+		return false;
+	}
+
+	LOG_F(INFO, "Mounted \"%s\" (%d files)\n", path.c_str(), (int)archive->getEntryCount());
+
+	std::lock_guard<std::mutex> l(m_archiveMutex);
+	m_archives.push_back(std::move(archive));
+	return true;
+}
+
+void FileManager::setLooseFileOverride(bool b)
+{
+	m_looseFileOverride = b;
+}
+
+bool FileManager::getLooseFileOverride() const
+{
+	return m_looseFileOverride;
+}
+
+void FileManager::prefetch(const std::vector<std::string>& paths, LoadPriority priority)
+{
+	m_prefetcher->prefetch(paths, priority);
+}
+
+FilePrefetcher& FileManager::getPrefetcher()
+{
+	return *m_prefetcher;
+}
+
+void FileManager::imgui()
+{
+	ResourcePtr<ImGuiManager> im;
+	bool* opened = im->win("Files");
+	if (*opened == false)
+		return;
+
+	using namespace ImGui;
+	if (Begin("Files", opened))
+	{
+		CacheStats cache = getCacheStats();
+		int lookups = cache.m_hits + cache.m_misses;
+		Text("Metadata cache: %d entries, %d listings", (int)cache.m_entries, (int)cache.m_listings);
+		Text("Hits: %d Misses: %d (%.1f%% hit rate) Invalidations: %d", cache.m_hits, cache.m_misses, lookups ? 100.0f * cache.m_hits / lookups : 0.0f, cache.m_invalidations);
+
+		FilePrefetcher::Stats prefetch = m_prefetcher->getStats();
+		Text("Prefetched: %d batches, %d files, %s (%d failed)", prefetch.m_batches, prefetch.m_files, prettySize(prefetch.m_bytes).c_str(), prefetch.m_failed);
+		Text("Loaders: %d hits, %d waited, %d misses", prefetch.m_hits, prefetch.m_waits, prefetch.m_misses);
+	}
+	End();
+}
+
+std::shared_ptr<const Archive> FileManager::findArchived(StringView path, const Archive::Entry** entry) const
+{
+	std::string name = normalizePath(path.c_str());
+
+	std::lock_guard<std::mutex> l(m_archiveMutex);
+	for (auto it = m_archives.rbegin(); it != m_archives.rend(); ++it)
+	{
+		*entry = (*it)->find(name);
+		if (*entry)
+			return *it;
+	}
+	return nullptr;
+}
+
+std::string FileManager::resolvePath(const char* path, bool warnIfMissing) const
 {
 	char buffer[256];
 	std::vector<std::string>::const_reverse_iterator it = m_paths.rbegin();
@@ -239,6 +417,6 @@ std::string FileManager::resolvePath(const char* path) const
 		++it;
 	}
 
-	LOG_F(WARNING, "File not found: %s\n", path);
+	LOG_IF_F(WARNING, warnIfMissing, "File not found: %s\n", path);
 	return std::string();
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <fstream>
 #include "File.h"
+#include "Archive.h"
 #include "../Resources/ResourceManager.h"
 #include "../Managers/EventManager.h"
 
@@ -10,6 +11,14 @@ struct FileChangeEvent : public Event<FileChangeEvent>
 	std::vector<std::string> m_files;
 };
 
+// a FileManager::prefetch() batch is in memory
+struct FilePrefetchedEvent : public Event<FilePrefetchedEvent>
+{
+	std::vector<std::string> m_paths; // ResourcePtr<File>(NewPtr, path) is loaded or about to be
+	std::vector<std::string> m_failed;
+};
+
+class FilePrefetcher;
 class FileManager : public SingletonResource<FileManager>, FW::FileWatchListener
 {
 public:
@@ -34,21 +43,62 @@ public:
 		Type m_type;
 	};
 	std::vector<FileInfo> files(const char* dir) const;
+
+	// exists, type, getModificationTime and files are answered from memory under watched directories,
+	// entries are dropped when the watcher reports a change
+	struct CacheStats
+	{
+		int m_hits{ 0 }, m_misses{ 0 }, m_invalidations{ 0 };
+		std::size_t m_entries{ 0 }, m_listings{ 0 };
+	};
+	CacheStats getCacheStats() const;
+	void invalidate(StringView path); // written outside of save(), don't wait for the watcher to notice
 	void reducePath(std::string&) const;
 
 	static std::string extension(StringView);
 	
 	void save(const char* path, std::vector<char>&&);
 
+	// files are looked up in the most recently mounted archive first, loose files in the search paths win while the override is on
+	bool mountArchive(StringView path);
+	void setLooseFileOverride(bool);
+	bool getLooseFileOverride() const;
+
+	// reads the files on the I/O threads in one batch, then creates their File resources with this priority
+	void prefetch(const std::vector<std::string>& paths, LoadPriority priority = LoadPriority::Prefetch);
+	FilePrefetcher& getPrefetcher();
+
+	void imgui();
+
 protected:
-	std::string resolvePath(const char*) const;
+	std::string resolvePath(const char*, bool warnIfMissing = true) const;
+	std::shared_ptr<const Archive> findArchived(StringView path, const Archive::Entry**) const;
 	Type type(DWORD) const;
+
+	struct Metadata
+	{
+		Type m_type;
+		std::int64_t m_modificationTime;
+	};
+	Metadata metadata(StringView path) const;
+	bool isWatched(const std::string& normalizedPath) const;
 	void handleFileAction(FW::WatchID watchid, const FW::String& dir, const FW::String& filename, FW::Action action);
 
 protected:
 	std::vector<std::string> m_paths;
+	std::vector<std::shared_ptr<const Archive>> m_archives;
+	mutable std::mutex m_archiveMutex;
+	std::atomic<bool> m_looseFileOverride{ true };
+	std::unique_ptr<FilePrefetcher> m_prefetcher;
 	ResourcePtr<ThreadPool> m_threadPool;
 	FW::FileWatcher m_fileWatcher;
+	std::vector<std::string> m_watched;
+
+	mutable std::mutex m_cacheMutex;
+	mutable std::unordered_map<StringId, Metadata> m_metadata; // negative results too
+	mutable std::unordered_map<std::string, std::vector<FileInfo>> m_listings;
+	mutable CacheStats m_cacheStats;
+	std::uint64_t m_cacheGeneration{ 0 }; // bumped by invalidate(), lookups that raced with it aren't cached
 	
 	struct FileChange
 	{
@@ -59,4 +109,5 @@ protected:
 	float m_lastFileChange;
 
 	friend class File;
+	friend class FilePrefetcher;
 };
\ No newline at end of file
@@ -0,0 +1,249 @@
+#include "stdafx.h"
+#include "FilePrefetcher.h"
+#include "FileManager.h"
+#include "MappedFile.h"
+#include "../Managers/TimeManager.h"
+#include "../Misc/Misc.h"
+
+const float FilePrefetcher::HoldSeconds = 10.0f;
+
+FilePrefetcher::FilePrefetcher(FileManager* fileManager, std::size_t threadCount):
+m_fileManager(fileManager)
+{
+	for (std::size_t i = 0; i < threadCount; i++)
+		m_threads.emplace_back([this]() { ioLoop(); });
+}
+
+FilePrefetcher::~FilePrefetcher()
+{
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_stop = true;
+	}
+	m_queued.notify_all();
+
+	for (std::thread& thread : m_threads)
+		thread.join();
+}
+
+void FilePrefetcher::prefetch(const std::vector<std::string>& paths, LoadPriority priority)
+{
+	std::unique_lock<std::mutex> l(m_mutex);
+	std::size_t id = m_nextBatch++;
+	Batch& batch = m_batches[id];
+	batch.m_priority = priority;
+	batch.m_remaining = 0;
+
+	auto& queue = m_queue[(std::size_t)priority];
+	for (const std::string& path : paths)
+	{
+		// already queued or read by another batch
+		if (!m_requests.emplace(path, Request()).second)
+			continue;
+
+		m_requests[path].m_batch = id;
+		queue.push_back(path);
+		batch.m_paths.push_back(path);
+		batch.m_remaining++;
+	}
+
+	if (batch.m_remaining == 0)
+	{
+		m_batches.erase(id);
+		return;
+	}
+
+	m_stats.m_batches++;
+	l.unlock();
+	m_queued.notify_all();
+}
+
+void FilePrefetcher::ioLoop()
+{
+	std::unique_lock<std::mutex> l(m_mutex);
+	while (true)
+	{
+		m_queued.wait(l, [this]() {
+			return m_stop || std::any_of(m_queue.begin(), m_queue.end(), [](const std::deque<std::string>& q) { return !q.empty(); });
+		});
+		if (m_stop)
+			return;
+
+		auto queue = std::find_if(m_queue.begin(), m_queue.end(), [](const std::deque<std::string>& q) { return !q.empty(); });
+		std::string path = std::move(queue->front());
+		queue->pop_front();
+
+		// a loader may have taken it over already
+		auto it = m_requests.find(path);
+		if (it == m_requests.end() || it->second.m_state != State::Queued)
+			continue;
+
+		Request* request = &it->second; // unordered_map nodes don't move
+		request->m_state = State::Reading;
+		l.unlock();
+
+		read(path, request);
+
+		l.lock();
+		request->m_state = request->m_error.empty() ? State::Done : State::Failed;
+		finish(request->m_batch, path, request->m_state == State::Failed);
+		m_read.notify_all();
+	}
+}
+
+void FilePrefetcher::read(const std::string& path, Request* request)
+{
+	// same lookup order as File::FileLoader
+	bool looseFirst = m_fileManager->getLooseFileOverride();
+	std::string resolved;
+	if (looseFirst)
+		resolved = m_fileManager->resolvePath(path.c_str(), false);
+
+	if (resolved.empty())
+	{
+		const Archive::Entry* entry = nullptr;
+		if (std::shared_ptr<const Archive> archive = m_fileManager->findArchived(path, &entry))
+		{
+			StringView stored = archive->getStored(*entry);
+			MappedFile::advise(stored.c_str(), stored.size(), MappedFile::Advice::WillNeed);
+			return;
+		}
+
+		if (!looseFirst)
+			resolved = m_fileManager->resolvePath(path.c_str(), false);
+
+		if (resolved.empty())
+		{
+			request->m_error = stringf("\"%s\" not found", path.c_str());
+			return;
+		}
+	}
+
+	std::unique_ptr<MappedFile> mapping(new MappedFile);
+	if (!mapping->open(resolved, MappedFile::Sequential, &request->m_error))
+		return;
+
+	// touch every page here, the loader shouldn't fault on any of them
+	const std::size_t pageSize = 4096;
+	const volatile char* content = mapping->getContent();
+	MappedFile::advise(mapping->getContent(), mapping->getSize(), MappedFile::Advice::WillNeed);
+	for (std::size_t offset = 0; offset < mapping->getSize(); offset += pageSize)
+		(void)content[offset];
+
+	request->m_mapping = std::move(mapping);
+}
+
+void FilePrefetcher::finish(std::size_t batch, const std::string& path, bool failed)
+{
+	// m_mutex must be locked
+	Batch& b = m_batches[batch];
+	b.m_remaining--;
+	if (failed)
+	{
+		b.m_failed.push_back(path);
+		m_stats.m_failed++;
+	}
+	m_stats.m_files++;
+}
+
+bool FilePrefetcher::take(const std::string& path, std::unique_ptr<MappedFile>* mapping)
+{
+	std::unique_lock<std::mutex> l(m_mutex);
+	auto it = m_requests.find(path);
+	if (it == m_requests.end())
+		return false;
+
+	Request& request = it->second;
+	if (request.m_state == State::Queued)
+	{
+		// the loader is already running, reading it here would only add a hop
+		finish(request.m_batch, path, false);
+		m_requests.erase(it);
+		m_stats.m_misses++;
+		return false;
+	}
+
+	if (request.m_state == State::Reading)
+	{
+		m_stats.m_waits++;
+		m_read.wait(l, [&request]() { return request.m_state != State::Reading; });
+	}
+	else
+	{
+		m_stats.m_hits++;
+	}
+
+	// failures are left to the loader so the error is reported the usual way
+	bool taken = request.m_state == State::Done && request.m_mapping;
+	if (taken)
+	{
+		m_stats.m_bytes += request.m_mapping->getSize();
+		*mapping = std::move(request.m_mapping);
+	}
+	m_requests.erase(it);
+	return taken;
+}
+
+void FilePrefetcher::update()
+{
+	ResourcePtr<TimeManager> time;
+	float now = time->getTime();
+
+	std::vector<Batch> finished;
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		for (auto it = m_batches.begin(); it != m_batches.end();)
+		{
+			if (it->second.m_remaining == 0)
+			{
+				finished.push_back(std::move(it->second));
+				it = m_batches.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+	ResourcePtr<EventManager> events;
+	for (Batch& batch : finished)
+	{
+		FilePrefetchedEvent* e = events->addOneFrameEvent<FilePrefetchedEvent>();
+		e->m_failed = std::move(batch.m_failed);
+
+		// the loaders only wrap the mappings, but still go through the resource manager so NewPtr finds them
+		ResourceManager::PriorityScope scope(batch.m_priority);
+		for (std::string& path : batch.m_paths)
+		{
+			if (std::find(e->m_failed.begin(), e->m_failed.end(), path) != e->m_failed.end())
+				continue;
+
+			m_holds.push_back({ ResourcePtr<File>(NewPtr, path), now + HoldSeconds });
+			e->m_paths.push_back(std::move(path));
+		}
+	}
+
+	m_holds.erase(std::remove_if(m_holds.begin(), m_holds.end(), [now](const Hold& hold) { return hold.m_until < now; }), m_holds.end());
+
+	// reads nobody took, ie. the File was already loaded or failed
+	std::lock_guard<std::mutex> l(m_mutex);
+	for (auto it = m_requests.begin(); it != m_requests.end();)
+	{
+		Request& request = it->second;
+		bool delivered = (request.m_state == State::Done || request.m_state == State::Failed) && m_batches.count(request.m_batch) == 0;
+		if (delivered && request.m_expires == 0.0f)
+			request.m_expires = now + HoldSeconds;
+
+		if (delivered && request.m_expires < now)
+			it = m_requests.erase(it);
+		else
+			++it;
+	}
+}
+
+FilePrefetcher::Stats FilePrefetcher::getStats() const
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	return m_stats;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "File.h"
+
+class FileManager;
+class MappedFile;
+
+// maps and pages in batches of files on its own I/O threads, so slow reads never hold up the ThreadPool.
+// Once a whole batch is in memory the File resources are created, their loaders just take the mapping
+class FilePrefetcher
+{
+public:
+	struct Stats
+	{
+		int m_batches{ 0 };
+		int m_files{ 0 };
+		std::size_t m_bytes{ 0 };
+		int m_hits{ 0 }; // loader took a finished read
+		int m_waits{ 0 }; // loader waited on a read in flight
+		int m_misses{ 0 }; // loader got there before the read started and did it itself
+		int m_failed{ 0 };
+	};
+
+public:
+	FilePrefetcher(FileManager*, std::size_t threadCount = 2);
+	FilePrefetcher(const FilePrefetcher&) = delete;
+	~FilePrefetcher();
+
+	void prefetch(const std::vector<std::string>& paths, LoadPriority);
+	void update(); // main thread, creates the File resources of finished batches and sends FilePrefetchedEvent
+
+	// called by File::FileLoader, false if the path wasn't prefetched or the loader has to open it itself.
+	// mapping stays null for archived files, only their pages were read in
+	bool take(const std::string& path, std::unique_ptr<MappedFile>* mapping);
+
+	Stats getStats() const;
+
+	static const float HoldSeconds; // prefetched File resources are kept this long for someone to pick up
+
+protected:
+	enum class State { Queued, Reading, Done, Failed };
+
+	struct Request
+	{
+		State m_state{ State::Queued };
+		std::size_t m_batch{ 0 };
+		std::unique_ptr<MappedFile> m_mapping;
+		std::string m_error;
+		float m_expires{ 0.0f }; // set once its batch was delivered, dropped if no loader took it by then
+	};
+
+	struct Batch
+	{
+		LoadPriority m_priority;
+		std::vector<std::string> m_paths;
+		std::vector<std::string> m_failed;
+		std::size_t m_remaining;
+	};
+
+	void ioLoop();
+	void read(const std::string& path, Request*);
+	void finish(std::size_t batch, const std::string& path, bool failed);
+
+protected:
+	FileManager* m_fileManager;
+	std::vector<std::thread> m_threads;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_queued; // wakes the I/O threads
+	std::condition_variable m_read; // wakes loaders waiting on a read in flight
+	std::array<std::deque<std::string>, (std::size_t)LoadPriority::Count> m_queue;
+	std::unordered_map<std::string, Request> m_requests;
+	std::map<std::size_t, Batch> m_batches;
+	std::size_t m_nextBatch{ 1 };
+	bool m_stop{ false };
+	Stats m_stats;
+
+	struct Hold
+	{
+		ResourcePtr<File> m_file;
+		float m_until;
+	};
+	std::vector<Hold> m_holds; // main thread only
+};
@@ -0,0 +1,161 @@
+#include "stdafx.h"
+#include "MappedFile.h"
+#include "../Misc/Misc.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::~MappedFile()
+{
+	if (m_content && !UnmapViewOfFile(m_content))
+		LOG_F(ERROR, "UnmapViewOfFile failed \"%s\" %X", m_path.c_str(), GetLastError());
+
+	if (m_hMapping && !CloseHandle(m_hMapping))
+		LOG_F(ERROR, "CloseHandle failed \"%s\" %X", m_path.c_str(), GetLastError());
+
+	if (m_hFile != INVALID_HANDLE_VALUE && !CloseHandle(m_hFile))
+		LOG_F(ERROR, "CloseHandle failed \"%s\" %X", m_path.c_str(), GetLastError());
+}
+
+bool MappedFile::open(const std::string& path, int flags, std::string* error)
+{
+	CHECK_F(m_hFile == INVALID_HANDLE_VALUE);
+	m_path = path;
+
+	DWORD disposition = (flags & Create) ? OPEN_ALWAYS : OPEN_EXISTING;
+	DWORD attributes = FILE_ATTRIBUTE_NORMAL | ((flags & Sequential) ? FILE_FLAG_SEQUENTIAL_SCAN : 0);
+	m_hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, disposition, attributes, nullptr);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+	{
+		*error = stringf("CreateFileA failed \"%s\" (%X)", path.c_str(), GetLastError());
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	FILETIME fileTime;
+	if (!GetFileSizeEx(m_hFile, &size) || !GetFileTime(m_hFile, nullptr, nullptr, &fileTime))
+	{
+		*error = stringf("Unable to stat \"%s\" (%X)", path.c_str(), GetLastError());
+		return false;
+	}
+	m_size = (std::size_t)size.QuadPart;
+	m_modificationTime = (std::int64_t)ULARGE_INTEGER{ fileTime.dwLowDateTime, fileTime.dwHighDateTime }.QuadPart;
+
+	// empty files can't be mapped
+	if (m_size == 0)
+		return true;
+
+	m_hMapping = CreateFileMapping(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_hMapping)
+	{
+		*error = stringf("CreateFileMapping failed \"%s\" (%X)", path.c_str(), GetLastError());
+		return false;
+	}
+
+	m_content = (const char*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (!m_content)
+	{
+		*error = stringf("MapViewOfFile failed \"%s\" (%X)", path.c_str(), GetLastError());
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::advise(const void* address, std::size_t size, Advice advice)
+{
+	// views have no access pattern hints, FILE_FLAG_SEQUENTIAL_SCAN covers the rest
+	if (advice != Advice::WillNeed || size == 0)
+		return;
+
+	WIN32_MEMORY_RANGE_ENTRY range = { const_cast<void*>(address), size };
+	if (!PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0))
+		LOG_F(WARNING, "PrefetchVirtualMemory failed (%X)\n", GetLastError());
+}
+#else
+MappedFile::~MappedFile()
+{
+	if (m_content && munmap(const_cast<char*>(m_content), m_size) != 0)
+		LOG_F(ERROR, "munmap failed \"%s\" (%s)", m_path.c_str(), strerror(errno));
+
+	if (m_fd >= 0 && close(m_fd) != 0)
+		LOG_F(ERROR, "close failed \"%s\" (%s)", m_path.c_str(), strerror(errno));
+}
+
+bool MappedFile::open(const std::string& path, int flags, std::string* error)
+{
+	CHECK_F(m_fd < 0);
+	m_path = path;
+
+	m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | ((flags & Create) ? O_CREAT : 0), 0644);
+	if (m_fd < 0)
+	{
+		*error = stringf("open failed \"%s\" (%s)", path.c_str(), strerror(errno));
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(m_fd, &info) != 0)
+	{
+		*error = stringf("fstat failed \"%s\" (%s)", path.c_str(), strerror(errno));
+		return false;
+	}
+	m_size = (std::size_t)info.st_size;
+
+	// same epoch and units as FILETIME, so archives and caches agree across platforms
+	const std::int64_t unixToFileTime = 11644473600LL;
+#ifdef __APPLE__
+	const struct timespec& time = info.st_mtimespec;
+#else
+	const struct timespec& time = info.st_mtim;
+#endif
+	m_modificationTime = ((std::int64_t)time.tv_sec + unixToFileTime) * 10000000LL + time.tv_nsec / 100;
+
+	// empty files can't be mapped
+	if (m_size == 0)
+		return true;
+
+	if (flags & Sequential)
+		posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	void* content = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+	if (content == MAP_FAILED)
+	{
+		*error = stringf("mmap failed \"%s\" (%s)", path.c_str(), strerror(errno));
+		return false;
+	}
+	m_content = (const char*)content;
+
+	if (flags & Sequential)
+		advise(m_content, m_size, Advice::Sequential);
+	return true;
+}
+
+void MappedFile::advise(const void* address, std::size_t size, Advice advice)
+{
+	if (size == 0)
+		return;
+
+	int flag = MADV_NORMAL;
+	switch (advice)
+	{
+	case Advice::Normal: flag = MADV_NORMAL; break;
+	case Advice::Sequential: flag = MADV_SEQUENTIAL; break;
+	case Advice::Random: flag = MADV_RANDOM; break;
+	case Advice::WillNeed: flag = MADV_WILLNEED; break;
+	}
+
+	// madvise wants a page aligned start
+	static const std::uintptr_t pageSize = (std::uintptr_t)sysconf(_SC_PAGESIZE);
+	std::uintptr_t start = (std::uintptr_t)address & ~(pageSize - 1);
+	std::uintptr_t end = (std::uintptr_t)address + size;
+	if (madvise((void*)start, end - start, flag) != 0)
+		LOG_F(WARNING, "madvise failed (%s)\n", strerror(errno));
+}
+#endif
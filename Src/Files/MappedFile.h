@@ -0,0 +1,48 @@
+#pragma once
+
+// read only view of a whole file, a Win32 file mapping or POSIX mmap.
+// Pages are read on first touch, advise() lets the OS start reading ahead of the loader
+class MappedFile
+{
+public:
+	enum OpenFlags
+	{
+		Create = 1, // create it empty if it doesn't exist
+		Sequential = 2 // read front to back once, ie. decoders
+	};
+
+	enum class Advice
+	{
+		Normal,
+		Sequential,
+		Random,
+		WillNeed // start reading it in now
+	};
+
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	~MappedFile();
+
+	bool open(const std::string& path, int flags, std::string* error);
+
+	const char* getContent() const { return m_content; }
+	std::size_t getSize() const { return m_size; }
+	std::int64_t getModificationTime() const { return m_modificationTime; } // 100ns ticks since 1601 on every platform, same as FILETIME
+
+	// hint for any range inside a mapping, rounded out to whole pages
+	static void advise(const void* address, std::size_t size, Advice);
+
+protected:
+	std::string m_path;
+	const char* m_content{ nullptr }; // null for empty files, nothing to map
+	std::size_t m_size{ 0 };
+	std::int64_t m_modificationTime{ 0 };
+
+#ifdef _WIN32
+	HANDLE m_hFile{ INVALID_HANDLE_VALUE };
+	HANDLE m_hMapping{ nullptr };
+#else
+	int m_fd{ -1 };
+#endif
+};
@@ -488,7 +488,7 @@ LuaTableResource::~LuaTableResource()
 
 LuaTableResource::LuaTableLoader::LuaTableLoader(const std::string& path, int flags) :m_path(path), m_file(NewPtr, path.c_str(), flags)
 {
-
+	dependsOn(m_file);
 }
 
 LuaTableResource::LuaTableLoader::~LuaTableLoader()
@@ -208,6 +208,7 @@ void EventManager::test()
 
 void EventManager::clearAllListeners()
 {
+	std::lock_guard<std::recursive_mutex> l(m_queuedListenersMutex);
 	m_listeners.clear();
 	m_queuedListeners.clear();
 	m_listenerData.clear();
@@ -230,6 +231,7 @@ void EventManager::clearEventBuffer(std::vector<char>& buffer, std::vector<TypeH
 void EventManager::insertQueuedListeners()
 {
 	// throw m_queuedListeners into m_listeners (uh, I should rename all these variables)
+	std::lock_guard<std::recursive_mutex> l(m_queuedListenersMutex);
 	for (auto& queuedListeners : m_queuedListeners)
 	{
 		std::map<int, FunctionPool>& eventListeners = m_listeners[queuedListeners.first];
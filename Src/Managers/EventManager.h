@@ -111,6 +111,7 @@ protected:
 	typedef VariableSizedMemoryPool<EventCallback, EventCallback::PoolHelper> FunctionPool;
 	std::map<EventBase::Id, std::map<int, FunctionPool> > m_listeners;
 	std::map<EventBase::Id, std::map<int, FunctionPool> > m_queuedListeners;
+	std::recursive_mutex m_queuedListenersMutex; // singletons can be constructed on several threads at once during startup
 	std::map<EventBase::Id, const char*> m_idToName;
 
 	struct ListenerData
@@ -167,6 +168,7 @@ void EventManager::processEventImmediately(EventType* e)
 template<typename EventType, typename FunctionType> void EventManager::addListener(FunctionType fn, int priority)
 {
 	// TODO: static_assert the arg types
+	std::lock_guard<std::recursive_mutex> l(m_queuedListenersMutex);
 	auto& eventListeners = m_queuedListeners[EventType::id()];
 	auto& priortyListeners = eventListeners[priority];
 	priortyListeners.push_back(makeFunction(fn));
@@ -179,6 +181,7 @@ template<typename Event> void EventManager::addListener(std::function<void(Event
 
 template<typename Event> void EventManager::addListenerFromScript(std::function<void(Event*)> fn, int priority)
 {
+	std::lock_guard<std::recursive_mutex> l(m_queuedListenersMutex);
 	auto& priortyListeners = m_queuedListeners[Event::id()][priority];
 
 	// find the index we're gonna be when we get added to m_listeners
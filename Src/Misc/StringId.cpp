@@ -0,0 +1,152 @@
+#include "stdafx.h"
+#include "StringId.h"
+#include "Misc.h"
+#include <shared_mutex>
+
+namespace
+{
+	struct Entry
+	{
+		std::string m_string;
+		std::size_t m_hash{ 0 };
+	};
+
+	// points into the query or into an Entry, lookups don't build a std::string
+	struct Key
+	{
+		const char* m_data;
+		std::size_t m_size;
+		std::size_t m_hash;
+
+		bool operator==(const Key& k) const { return m_size == k.m_size && memcmp(m_data, k.m_data, m_size) == 0; }
+	};
+
+	struct KeyHash
+	{
+		std::size_t operator()(const Key& k) const { return k.m_hash; }
+	};
+
+	class StringInterner
+	{
+	public:
+		StringInterner()
+		{
+			for (auto& chunk : m_chunks)
+				chunk.store(nullptr, std::memory_order_relaxed);
+
+			add({ "", 0, StringId::hash(StringView("")) }); // id 0
+		}
+
+		~StringInterner()
+		{
+			for (auto& chunk : m_chunks)
+				delete[] chunk.load(std::memory_order_relaxed);
+		}
+
+		std::uint32_t intern(StringView s)
+		{
+			Key key = { s.c_str() ? s.c_str() : "", s.size(), StringId::hash(s) };
+			{
+				std::shared_lock<std::shared_timed_mutex> l(m_mutex);
+				auto it = m_ids.find(key);
+				if (it != m_ids.end())
+					return it->second;
+			}
+
+			std::unique_lock<std::shared_timed_mutex> l(m_mutex);
+			auto it = m_ids.find(key);
+			if (it != m_ids.end())
+				return it->second; // interned by another thread in between
+			return add(key);
+		}
+
+		const Entry& get(std::uint32_t id) const
+		{
+			return m_chunks[id / ChunkSize].load(std::memory_order_acquire)[id % ChunkSize];
+		}
+
+		StringId::Stats getStats() const
+		{
+			std::shared_lock<std::shared_timed_mutex> l(m_mutex);
+			StringId::Stats stats;
+			stats.m_count = m_count;
+			stats.m_bytes = m_bytes;
+			return stats;
+		}
+
+	protected:
+		std::uint32_t add(const Key& key)
+		{
+			// m_mutex must be locked exclusively
+			std::uint32_t id = m_count;
+			CHECK_F(id < ChunkSize * MaxChunks, "Out of string ids");
+
+			// entries live in fixed size chunks so get() can read them while others are added
+			std::atomic<Entry*>& chunk = m_chunks[id / ChunkSize];
+			if (!chunk.load(std::memory_order_relaxed))
+				chunk.store(new Entry[ChunkSize], std::memory_order_release);
+
+			Entry& entry = chunk.load(std::memory_order_relaxed)[id % ChunkSize];
+			entry.m_string.assign(key.m_data, key.m_size);
+			entry.m_hash = key.m_hash;
+			m_ids.emplace(Key{ entry.m_string.c_str(), entry.m_string.size(), entry.m_hash }, id);
+
+			m_count++;
+			m_bytes += key.m_size;
+			return id;
+		}
+
+	protected:
+		static const std::uint32_t ChunkSize = 4096;
+		static const std::uint32_t MaxChunks = 4096;
+
+		mutable std::shared_timed_mutex m_mutex;
+		std::unordered_map<Key, std::uint32_t, KeyHash> m_ids;
+		std::array<std::atomic<Entry*>, MaxChunks> m_chunks;
+		std::uint32_t m_count{ 0 };
+		std::size_t m_bytes{ 0 };
+	};
+
+	StringInterner& interner()
+	{
+		static StringInterner s_interner;
+		return s_interner;
+	}
+}
+
+StringId::StringId(StringView s):
+m_id(interner().intern(s))
+{
+
+}
+
+StringId StringId::path(StringView p)
+{
+	const char* end = p.c_str() + p.size();
+	if (std::find(p.c_str(), end, '\\') == end)
+		return StringId(p);
+
+	std::string normalized = p.str();
+	normalizePath(normalized);
+	return StringId(StringView(normalized));
+}
+
+std::size_t StringId::hash(StringView s)
+{
+	return generateHash(s.c_str(), s.size());
+}
+
+const std::string& StringId::str() const
+{
+	return interner().get(m_id).m_string;
+}
+
+std::size_t StringId::getHash() const
+{
+	return interner().get(m_id).m_hash;
+}
+
+StringId::Stats StringId::getStats()
+{
+	return interner().getStats();
+}
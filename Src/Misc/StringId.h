@@ -0,0 +1,49 @@
+#pragma once
+
+#include "StringView.h"
+
+// interned string, each distinct string gets one id for the whole run.
+// Ids compare and hash as integers, the string and its hash are only stored once
+class StringId
+{
+public:
+	struct Stats
+	{
+		std::size_t m_count{ 0 };
+		std::size_t m_bytes{ 0 };
+	};
+
+public:
+	StringId() = default; // the empty string
+	explicit StringId(StringView);
+
+	static StringId path(StringView); // normalizePath'd first, only allocates if it had backslashes
+	static std::size_t hash(StringView); // what getHash() returns once it's interned, without interning it
+
+	const std::string& str() const; // lock free, the string never moves
+	const char* c_str() const { return str().c_str(); }
+	std::size_t size() const { return str().size(); }
+	bool empty() const { return m_id == 0; }
+
+	std::uint32_t getId() const { return m_id; }
+	std::size_t getHash() const;
+
+	operator StringView() const { return str(); }
+
+	bool operator==(StringId id) const { return m_id == id.m_id; }
+	bool operator!=(StringId id) const { return m_id != id.m_id; }
+	bool operator<(StringId id) const { return m_id < id.m_id; } // interning order, not alphabetical
+
+	static Stats getStats();
+
+protected:
+	std::uint32_t m_id{ 0 };
+};
+
+namespace std
+{
+	template<> struct hash<StringId>
+	{
+		std::size_t operator()(StringId id) const { return std::hash<std::uint32_t>{}(id.getId()); }
+	};
+}
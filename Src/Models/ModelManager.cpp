@@ -1,8 +1,11 @@
 #include "stdafx.h"
 #include "ModelManager.h"
 #include "../Files/File.h"
+#include "../Files/CookedAsset.h"
+#include "../Files/DerivedCache.h"
 #include "../Rendering/Buffer.h"
 #include "../Managers/EventManager.h"
+#include "../Threading/MainThreadQueue.h"
 #include "../Misc/Misc.h"
 #include "../Rendering/Buffer.h"
 
@@ -22,23 +25,24 @@ ModelManager::~ModelManager()
 
 Model ModelManager::getModel(const char* _path)
 {
-	std::string path = normalizePath(_path);
-	for (auto& model : m_models)
-	{
-		if (model.second.m_path == path)
-			return model.first;
-	}
+	StringId path = StringId::path(_path);
+	auto found = m_paths.find(path);
+	if (found != m_paths.end())
+		return found->second;
 
 	Model model = m_nextModelId;
 	m_nextModelId.m_value++;
-	auto it = m_models.emplace(std::make_pair(model, ModelData(path.c_str())));
+	m_paths.emplace(path, model);
+	auto it = m_models.emplace(std::make_pair(model, ModelData(path)));
 	ModelData& modelData = it.first->second;
 
 	ResourcePtr<EventManager> events;
 	events->addListener<ResourceStateChanged>([&modelData, this](ResourceStateChanged* e) {
 		if (modelData.m_file == e->m_resourceData)
 		{
-			onModelDataLoaded(const_cast<ModelData*>(&modelData)); // where does this const come from...?
+			ModelData* data = const_cast<ModelData*>(&modelData); // where does this const come from...?
+			ResourcePtr<MainThreadQueue> queue;
+			queue->post(MainThreadQueue::Priority::Normal, [data, this]() { onModelDataLoaded(data); }, "Model buffers");
 			e->discardListener();
 		}
 	});
@@ -54,47 +58,70 @@ const ModelManager::ModelData* ModelManager::getModelData(const Model& model) co
 
 void ModelManager::onModelDataLoaded(ModelData* e)
 {
-	if (endsWith(e->m_path, ".fbx", 4))
+	if (loadCooked(e, e->m_file->getContents()))
+		return;
+
+	if (endsWith(e->m_path.str(), ".fbx", 4))
 		loadFBX(e);
 }
 
-void ModelManager::loadFBX(ModelData* data) const
+bool ModelManager::loadCooked(ModelData* data, StringView contents) const
 {
-	ResourcePtr<File>& file = data->m_file;
-	ofbx::IScene* scene = ofbx::load((ofbx::u8*)file->getContents().c_str(), (int)file->getSize(), (ofbx::u64)ofbx::LoadFlags::TRIANGULATE);
-	const ofbx::Mesh* mesh = scene->getMesh(0);
-	const ofbx::Geometry* geo = mesh->getGeometry();
-	const ofbx::Vec3* positions = geo->getVertices();
-	const ofbx::Vec2* uvs = geo->getUVs();
-	const int* face = geo->getFaceIndices();
-
-	//scene->getGlobalSettings();
-
-	// setup and copy into vertex buffer
-	struct Vert {
-		glm::vec3 m_position;
-		glm::vec2 m_uv;
-	};
-	data->m_vertexCount = geo->getIndexCount();
-	data->m_vBuffer = new Rendering::Buffer(Rendering::Buffer::Vertex, Rendering::Buffer::Usage::Mapped, data->m_vertexCount * sizeof(Vert));
+	typedef CookedAsset::Mesh Cooked;
+	typedef CookedAsset::MeshVertex Vert;
+	const Cooked* cooked = (const Cooked*)CookedAsset::read(contents, CookedAsset::Type::Mesh, sizeof(Cooked));
+	if (!cooked)
+		return false;
+
+	std::size_t verticesSize = cooked->m_vertexCount * sizeof(Vert);
+	std::size_t indicesSize = cooked->m_indexCount * sizeof(std::uint32_t);
+	if (contents.size() < sizeof(CookedAsset::Header) + sizeof(Cooked) + verticesSize + indicesSize)
+	{
+		LOG_F(WARNING, "Cooked mesh \"%s\" is truncated\n", data->m_path.c_str());
+		return true;
+	}
+
+	// already de-indexed and welded by the cooker, both buffers are straight copies
+	const char* vertices = (const char*)(cooked + 1);
+	data->m_vertexCount = cooked->m_vertexCount;
+	data->m_vBuffer = new Rendering::Buffer(Rendering::Buffer::Vertex, Rendering::Buffer::Usage::Mapped, verticesSize);
 	data->m_vBuffer->setFormat({
 		{vk::Format::eR32G32B32Sfloat, sizeof(glm::vec3)},
 		{vk::Format::eR32G32Sfloat, sizeof(glm::vec2)}
 	}, sizeof(Vert));
+	memcpy(data->m_vBuffer->map(), vertices, verticesSize);
+	data->m_vBuffer->unmap();
 
-	Vert* vertexDest = (Vert*)data->m_vBuffer->map();
-	for (int i = 0; i < data->m_vertexCount; i++)
+	data->m_indexCount = cooked->m_indexCount;
+	data->m_iBuffer = new Rendering::Buffer(Rendering::Buffer::Index, Rendering::Buffer::Usage::Mapped, indicesSize);
+	data->m_iBuffer->setFormat({ {vk::Format::eR32Uint, sizeof(std::uint32_t)} }, sizeof(std::uint32_t));
+	memcpy(data->m_iBuffer->map(), vertices + verticesSize, indicesSize);
+	data->m_iBuffer->unmap();
+	return true;
+}
+
+void ModelManager::loadFBX(ModelData* data) const
+{
+	// welded into an indexed mesh once, then copied straight out of the DerivedCache
+	ResourcePtr<DerivedCache> cache;
+	StringView source = data->m_file->getContents();
+	DerivedCache::Key key = DerivedCache::key("mesh", CookedAsset::Version, source);
+
+	std::vector<char> cooked;
+	if (!cache->get(key, &cooked))
 	{
-		int posIndex = (face[i] < 0 ? (-face[i]) - 1 : face[i]);
-		vertexDest[i].m_position = glm::vec3(positions[posIndex].x, positions[posIndex].y, positions[posIndex].z);
-		vertexDest[i].m_uv = glm::vec2(uvs[i].x, 1.0f - uvs[i].y);
+		if (!CookedAsset::cookMesh(source, &cooked))
+		{
+			LOG_F(ERROR, "Unable to load \"%s\"\n", data->m_path.c_str());
+			return;
+		}
+		cache->put(key, StringView(cooked.data(), cooked.data() + cooked.size()));
 	}
-	data->m_vBuffer->unmap();
 
-	scene->destroy();
+	loadCooked(data, StringView(cooked.data(), cooked.data() + cooked.size()));
 }
 
-ModelManager::ModelData::ModelData(const char* path):
+ModelManager::ModelData::ModelData(StringId path):
 m_path(path),
 m_file(NewPtr, path),
 m_vBuffer(nullptr),
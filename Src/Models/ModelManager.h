@@ -3,6 +3,7 @@
 #include "../Resources/ResourceManager.h"
 #include "../ECS/ECS.h"
 #include "../Misc/Misc.h"
+#include "../Misc/StringId.h"
 
 class File;
 class ModelManager;
@@ -17,9 +18,9 @@ class ModelManager : public SingletonResource<ModelManager>
 public:
 	struct ModelData
 	{
-		ModelData(const char* path);
+		ModelData(StringId path);
 
-		std::string m_path;
+		StringId m_path;
 		ResourcePtr<File> m_file;
 		Rendering::Buffer *m_vBuffer, *m_iBuffer;
 		std::size_t m_vertexCount, m_indexCount;
@@ -36,9 +37,11 @@ protected:
 	struct ModelData;
 	void onModelDataLoaded(ModelData*);
 	void loadFBX(ModelData*) const;
+	bool loadCooked(ModelData*, StringView contents) const;
 
 protected:
 	std::map<Model, ModelData> m_models;
+	std::unordered_map<StringId, Model> m_paths;
 
 	Model m_nextModelId;
 };
\ No newline at end of file
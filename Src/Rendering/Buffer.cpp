@@ -22,6 +22,7 @@ void Buffer::recreate(Type type, Usage usage, std::size_t size)
 {
 	if(m_buffer)
 		vmaDestroyBuffer(m_device->getVMA(), m_buffer, m_allocation);
+	m_mapped = nullptr;
 
 	if (size <= 0)
 		return;
@@ -29,7 +30,8 @@ void Buffer::recreate(Type type, Usage usage, std::size_t size)
 	VkBufferCreateInfo bufferInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
 	switch (type)
 	{
-	case Type::Vertex: bufferInfo.usage |= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT; break;
+	case Type::Vertex:
+	case Type::Instance: bufferInfo.usage |= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT; break;
 	case Type::Index: bufferInfo.usage |= VK_BUFFER_USAGE_INDEX_BUFFER_BIT; break;
 	case Type::Uniform: bufferInfo.usage |= VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT; break;
 	}
@@ -40,13 +42,16 @@ void Buffer::recreate(Type type, Usage usage, std::size_t size)
 	{
 	case Usage::Static: allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY; break;
 	case Usage::Mapped: allocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;  break;
+	case Usage::Persistent: allocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU; allocInfo.flags |= VMA_ALLOCATION_CREATE_MAPPED_BIT; break;
 	}
 
 	VkBuffer buffer;
-	auto r = vmaCreateBuffer(m_device->getVMA(), &bufferInfo, &allocInfo, &buffer, &m_allocation, nullptr);
+	VmaAllocationInfo info = {};
+	auto r = vmaCreateBuffer(m_device->getVMA(), &bufferInfo, &allocInfo, &buffer, &m_allocation, &info);
 	checkVkResult(r);
 
 	m_buffer = buffer;
+	m_mapped = usage == Usage::Persistent ? info.pMappedData : nullptr;
 }
 
 Buffer::Type Buffer::getType() const
@@ -61,6 +66,9 @@ Buffer::Usage Buffer::getUsage() const
 
 void* Buffer::map()
 {
+	if (m_usage == Usage::Persistent)
+		return m_mapped;
+
 	void* data = nullptr;
 	VkResult r = vmaMapMemory(m_device->getVMA(), m_allocation, &data);
 	checkVkResult(r);
@@ -69,15 +77,27 @@ void* Buffer::map()
 
 void Buffer::unmap()
 {
-	vmaUnmapMemory(m_device->getVMA(), m_allocation);
+	if (m_usage != Usage::Persistent)
+		vmaUnmapMemory(m_device->getVMA(), m_allocation);
 }
 
-void Buffer::grow(std::size_t minSize)
+void Buffer::flush(std::size_t offset, std::size_t size)
 {
-	if (m_size >= minSize || minSize < 0)
-		return;
+	vmaFlushAllocation(m_device->getVMA(), m_allocation, offset, size);
+}
+
+bool Buffer::grow(std::size_t minSize)
+{
+	if (m_size >= minSize)
+		return false;
+
+	std::size_t size = m_size == 0 ? 64 : m_size;
+	while (size < minSize)
+		size *= 2;
 
-	recreate(m_type, m_usage, m_size == 0 ? 64 : m_size * 2);
+	m_size = size;
+	recreate(m_type, m_usage, size);
+	return true;
 }
 
 void Buffer::setFormat(std::vector<Format>&& format, std::size_t stride)
@@ -14,8 +14,8 @@ namespace Rendering
 		};
 
 	public:
-		enum Type {Vertex, Index, Uniform};
-		enum Usage {Static, Mapped};
+		enum Type {Vertex, Index, Uniform, Instance}; // Instance is a vertex buffer stepped once per instance
+		enum Usage {Static, Mapped, Persistent}; // Persistent stays mapped for its lifetime, map() is free and unmap() does nothing
 		Buffer(Type, Usage, std::size_t size);
 		~Buffer();
 
@@ -24,8 +24,9 @@ namespace Rendering
 
 		void* map();
 		void unmap();
+		void flush(std::size_t offset, std::size_t size); // makes cpu writes visible if the memory isn't coherent
 
-		void grow(std::size_t minSize);
+		bool grow(std::size_t minSize); // at least doubles, false if it was big enough. Contents are lost when it grows
 
 		void setFormat(std::vector<Format>&&, std::size_t stride);
 		const std::vector<Format>& getFormat() const;
@@ -44,6 +45,7 @@ namespace Rendering
 		ResourcePtr<Rendering::Device> m_device;
 		vk::Buffer m_buffer;
 		VmaAllocation m_allocation;
+		void* m_mapped{ nullptr };
 		std::vector<Format> m_format;
 		std::size_t m_stride;
 	};
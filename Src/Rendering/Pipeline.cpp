@@ -14,7 +14,7 @@ Pipeline::PipelineLoader::PipelineLoader(const char* dataPath):
 m_table(NewPtr, dataPath),
 m_device()
 {
-
+	dependsOn(m_table);
 }
 
 Pipeline::PipelineLoader::~PipelineLoader()
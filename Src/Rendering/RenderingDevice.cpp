@@ -14,6 +14,20 @@
 
 using namespace Rendering;
 
+// hashes and compares the bytes before m_hash, the members are laid out without padding
+static const std::size_t s_pipelineKeySize = offsetof(PipelineKey, m_hash);
+static_assert(offsetof(PipelineKey, m_hash) == 3 * sizeof(VkRenderPass) + sizeof(std::uint64_t) + 6 * sizeof(std::uint32_t), "PipelineKey has padding");
+
+void PipelineKey::computeHash()
+{
+	m_hash = generateHash(this, s_pipelineKeySize);
+}
+
+bool PipelineKey::operator==(const PipelineKey& k) const
+{
+	return m_hash == k.m_hash && memcmp(this, &k, s_pipelineKeySize) == 0;
+}
+
 Device::Device():
 m_instance(),
 m_physicalDevice(),
@@ -66,6 +80,9 @@ Device::~Device()
 				// destroy frame buffer?
 			}
 
+			for (auto& recorder : frame->m_recorders)
+				m_device.destroyCommandPool(recorder.m_commandPool);
+
 			delete frame;
 		}
 	}
@@ -318,6 +335,16 @@ std::tuple<vk::Framebuffer, glm::u32vec2> Device::getFrameBuffer() const
 	return std::tie(m_currentFrameResources->m_frameBuffer, m_currentWindowResources->m_frameDimensions);
 }
 
+std::size_t Device::getFrameCount() const
+{
+	return m_currentWindowResources ? std::max<std::size_t>(m_currentWindowResources->m_frameResources.size(), 1) : 1;
+}
+
+std::size_t Device::getCurrentFrame() const
+{
+	return (std::size_t)m_currentFrame;
+}
+
 RootUnit& Device::getRootUnit()
 {
 	return *m_rootUnit;
@@ -363,10 +390,24 @@ void Device::submitAll()
 		}
 	}
 
+	// runs of draws are recorded together, in parallel when they're long enough. Uploads and layout changes go between runs
 	bool needsClear = true;
-	for (auto& unit : m_rootUnit->m_submitted)
+	std::vector<Unit>& submitted = m_rootUnit->m_submitted;
+	std::vector<Unit::DrawCall> draws;
+	for (std::size_t i = 0; i < submitted.size();)
 	{
-		unit.submitCommandBuffers(this, &resources, commandBuffer, needsClear);
+		draws.clear();
+		Unit::DrawCall draw;
+		for (std::size_t j = i; j < submitted.size() && !submitted[j].isTransfer() && submitted[j].prepareDrawCall(this, &draw); j++)
+			draws.push_back(draw);
+
+		if (draws.empty())
+			submitted[i++].submitCommandBuffers(this, &resources, commandBuffer, needsClear);
+		else
+		{
+			Unit::submitDrawCalls(this, commandBuffer, &submitted[i], draws, needsClear);
+			i += draws.size();
+		}
 		needsClear = false;
 	}
 
@@ -405,6 +446,7 @@ void Device::update()
 	m_device.resetDescriptorPool(threadRes->m_descriptorPool);
 	m_device.resetCommandPool(threadRes->m_commandPool, {});
 	threadRes->m_commandBuffersUsed = 0;
+	m_currentFrameResources->m_recordersUsed = 0; // begin() resets them, their pools allow it
 }
 
 VkBuffer Device::createTransferBuffer(std::size_t size, void* data)
@@ -493,6 +535,7 @@ vk::Pipeline Device::createObject(const vk::GraphicsPipelineCreateInfo& info)
 		vk::ResultValue<vk::Pipeline> r = m_device.createGraphicsPipeline(m_pipelineCache, info, m_allocator);
 		checkVkResult(r.result);
 		m_recorder.record_graphics_pipeline(r.value, info, nullptr, 0);
+		m_pipelinesCreated++;
 
 		it = m_objects.insert({ hash, r.value }).first;
 	}
@@ -591,9 +634,52 @@ void Device::destroyObject(vk::RenderPass pass)
 		{
 			m_device.destroyRenderPass(*rp);
 			m_objects.erase(it);
-			return;
+			break;
 		}
 	}
+
+	// the handle can come back for a pass with other formats
+	std::unique_lock<std::shared_timed_mutex> l(m_pipelineMutex);
+	for (auto it = m_pipelines.begin(); it != m_pipelines.end();)
+	{
+		if (it->first.m_renderPass == (VkRenderPass)pass)
+			it = m_pipelines.erase(it);
+		else
+			++it;
+	}
+}
+
+bool Device::findPipeline(const PipelineKey& key, PipelineObjects* objects)
+{
+	std::shared_lock<std::shared_timed_mutex> l(m_pipelineMutex);
+	auto it = m_pipelines.find(key);
+	if (it == m_pipelines.end())
+	{
+		m_pipelineMisses++;
+		return false;
+	}
+
+	*objects = it->second;
+	m_pipelineHits++;
+	return true;
+}
+
+void Device::addPipeline(const PipelineKey& key, const PipelineObjects& objects)
+{
+	// two threads missing on the same key both build it, createObject hands them the same pipeline
+	std::unique_lock<std::shared_timed_mutex> l(m_pipelineMutex);
+	m_pipelines.emplace(key, objects);
+}
+
+PipelineStats Device::getPipelineStats() const
+{
+	std::shared_lock<std::shared_timed_mutex> l(m_pipelineMutex);
+	PipelineStats stats;
+	stats.m_hits = m_pipelineHits;
+	stats.m_misses = m_pipelineMisses;
+	stats.m_created = m_pipelinesCreated;
+	stats.m_entries = m_pipelines.size();
+	return stats;
 }
 
 void Device::destroyObject(vk::ImageView view)
@@ -792,6 +878,21 @@ void Device::imgui()
 		}
 		End();
 	}
+
+	bool* pipelines = imgui->win("Pipelines", "Rendering");
+	if (*pipelines)
+	{
+		if (Begin("Pipelines", pipelines))
+		{
+			PipelineStats stats = getPipelineStats();
+			int lookups = stats.m_hits + stats.m_misses;
+			Text("Keys: %d", (int)stats.m_entries);
+			Text("Hits: %d Misses: %d (%.1f%% hit rate)", stats.m_hits, stats.m_misses, lookups ? 100.0f * stats.m_hits / lookups : 0.0f);
+			Text("Created: %d", stats.m_created);
+			if (IsItemHovered()) SetTooltip("vkCreateGraphicsPipelines calls, a miss with the same create info reuses the Fossilize hashed pipeline");
+		}
+		End();
+	}
 }
 
 vk::Result Device::create(vk::DescriptorPool* pool) const
@@ -833,6 +934,25 @@ vk::Result Device::create(vk::CommandPool* pool) const
 	return r;
 }
 
+vk::CommandBuffer Device::getRecordingBuffer()
+{
+	// submitting thread only, the batches are handed out before recording starts
+	FrameResources& frame = *m_currentFrameResources;
+	if (frame.m_recordersUsed == frame.m_recorders.size())
+	{
+		Recorder recorder;
+		vk::Result r = create(&recorder.m_commandPool);
+		checkVkResult(r);
+
+		auto buffers = m_device.allocateCommandBuffers({ recorder.m_commandPool, vk::CommandBufferLevel::eSecondary, 1 });
+		checkVkResult(buffers.result);
+		recorder.m_commandBuffer = buffers.value[0];
+		frame.m_recorders.push_back(recorder);
+	}
+
+	return frame.m_recorders[frame.m_recordersUsed++].m_commandBuffer;
+}
+
 void Device::allocateThreadResources(const std::thread::id& id)
 {
 	for (auto& window : m_windowResources)
@@ -3,12 +3,55 @@
 #include "../Misc/Any.h"
 #include "../Resources/ResourceManager.h"
 #include "../Misc/Callbacks.h"
+#include <shared_mutex>
 namespace Rendering
 {
 	class Unit;
 	class RootUnit;
 	class Shader;
 	class RenderTarget;
+
+	// everything a Unit's graphics pipeline is built from, filled in once when it's submitted (see Unit::createPipelineKey).
+	// The render pass stands in for the target formats, the blend state is the same for every Unit
+	struct PipelineKey
+	{
+		VkShaderModule m_vertexShader{ VK_NULL_HANDLE };
+		VkShaderModule m_fragShader{ VK_NULL_HANDLE };
+		VkRenderPass m_renderPass{ VK_NULL_HANDLE };
+		std::uint64_t m_layout{ 0 }; // vertex and instance formats, descriptor bindings, push constant ranges
+		std::uint32_t m_flags{ 0 }; // vk::PipelineCreateFlags
+		std::uint32_t m_topology{ 0 };
+		std::uint32_t m_polygonMode{ 0 };
+		std::uint32_t m_cullMode{ 0 }; // front face in the bits above the cull mode flags
+		std::uint32_t m_depth{ 0 }; // compare op, test and write bits
+		float m_lineWidth{ 1.0f };
+		std::size_t m_hash{ 0 }; // of everything above, set by computeHash()
+
+		void computeHash();
+		bool operator==(const PipelineKey&) const;
+	};
+
+	struct PipelineKeyHash
+	{
+		std::size_t operator()(const PipelineKey& k) const { return k.m_hash; }
+	};
+
+	// what a pipeline hit hands back, a Unit doesn't have to build the layouts either
+	struct PipelineObjects
+	{
+		vk::Pipeline m_pipeline;
+		vk::PipelineLayout m_layout;
+		vk::DescriptorSetLayout m_setLayout;
+	};
+
+	struct PipelineStats
+	{
+		int m_hits{ 0 };
+		int m_misses{ 0 };
+		int m_created{ 0 }; // vkCreateGraphicsPipelines calls, misses can still share a pipeline through the Fossilize hash
+		std::size_t m_entries{ 0 };
+	};
+
 	class Device : public SingletonResource<Device>
 	{
 	public:
@@ -37,6 +80,8 @@ namespace Rendering
 		vk::RenderPass getRenderPass() const;
 		vk::RenderPass getClearingRenderPass() const;
 		std::tuple<vk::Framebuffer, glm::u32vec2> getFrameBuffer() const;
+		std::size_t getFrameCount() const; // frames in flight, update() waits for getCurrentFrame()'s last use
+		std::size_t getCurrentFrame() const;
 		vk::DescriptorPool getDescriptorPool(const std::thread::id & = std::this_thread::get_id());
 		vk::DescriptorPool getPersistentDescriptorPool(const std::thread::id & = std::this_thread::get_id());
 
@@ -65,6 +110,11 @@ namespace Rendering
 		vk::ImageView createObject(const vk::ImageViewCreateInfo&);
 		template<typename T> T& getObject(std::size_t id) const;
 
+		// thread safe, lookups only take a shared lock
+		bool findPipeline(const PipelineKey&, PipelineObjects*);
+		void addPipeline(const PipelineKey&, const PipelineObjects&);
+		PipelineStats getPipelineStats() const;
+
 		void destroyObject(vk::RenderPass);
 		void destroyObject(vk::ImageView);
 
@@ -89,6 +139,7 @@ namespace Rendering
 	protected:
 		vk::Result create(vk::DescriptorPool*) const;
 		vk::Result create(vk::CommandPool*) const;
+		vk::CommandBuffer getRecordingBuffer(); // a secondary, until the frame comes around again
 
 		struct ThreadResources;
 		//void allocateThreadResources(const std::thread::id&);
@@ -119,6 +170,14 @@ namespace Rendering
 			vk::DescriptorPool m_persistentDescriptorPool;
 		};
 
+		// a secondary command buffer for one batch of parallel recording, with its own pool since
+		// pool threads don't have ThreadResources and a pool can't be used from two threads at once
+		struct Recorder
+		{
+			vk::CommandPool m_commandPool;
+			vk::CommandBuffer m_commandBuffer;
+		};
+
 		struct FrameResources
 		{
 			vk::Image m_frameImage;
@@ -128,6 +187,8 @@ namespace Rendering
 			vk::Fence m_fence;
 			std::map<std::thread::id, ThreadResources> m_threadResources;
 			bool m_layoutDefined;
+			std::vector<Recorder> m_recorders;
+			std::size_t m_recordersUsed{ 0 };
 		};
 
 		struct WindowResources
@@ -155,6 +216,12 @@ namespace Rendering
 
 		std::map<Fossilize::Hash, Any> m_objects;
 
+		mutable std::shared_timed_mutex m_pipelineMutex;
+		std::unordered_map<PipelineKey, PipelineObjects, PipelineKeyHash> m_pipelines;
+		std::atomic<int> m_pipelineHits{ 0 };
+		std::atomic<int> m_pipelineMisses{ 0 };
+		std::atomic<int> m_pipelinesCreated{ 0 };
+
 		friend class VulkanFramework;
 		friend class Unit;
 	};
@@ -5,6 +5,7 @@
 #include "RenderingDevice.h"
 #include "../Misc/Misc.h"
 #include "../Files/FileManager.h"
+#include "../Files/DerivedCache.h"
 
 using namespace Rendering;
 
@@ -71,7 +72,7 @@ bool Shader::compile(StringView path, std::string* outError)
 
 	bool hasError = !error.str().empty();
 	if (hasError && outError) *outError = error.str();
-	return hasError;
+	return !hasError;
 }
 
 void Shader::setCompiled(uint32_t* bytes, int size)
@@ -147,7 +148,7 @@ std::tuple<bool, std::size_t> Shader::getSharedHash(Type type, const char* code)
 Shader::ShaderLoader::ShaderLoader(Type type, const char* code):
 m_type(type),
 m_code(code),
-m_cacheFile(EmptyPtr)
+m_shader(nullptr)
 {
 
 }
@@ -162,12 +163,17 @@ Shader* Shader::ShaderLoader::load(std::tuple<int, std::string>* error)
 	if(!m_shader)
 		m_shader = new Shader(m_type, m_code.c_str());
 
-	std::string cachePath = m_shader->getCachePath();
+	// bump when glslangValidator or its arguments change
+	const std::uint32_t compilerVersion = 1;
+	ResourcePtr<DerivedCache> cache;
+	DerivedCache::Key key = DerivedCache::key("spirv", compilerVersion, m_code, m_type == Type::Vertex ? "vert" : "frag");
 
-	ResourcePtr<FileManager> files;
-	if (!m_cacheFile && !files->exists(cachePath.c_str()))
+	std::vector<char> spirv;
+	if (!cache->get(key, &spirv))
 	{
-		if (!m_shader->compile(cachePath, &std::get<1>(*error)))
+		// the compiler only writes files, it's read back into the cache
+		std::string outputPath = m_shader->getCachePath();
+		if (!m_shader->compile(outputPath, &std::get<1>(*error)))
 		{
 			std::get<0>(*error) = -1;
 			LOG_F(ERROR, "Failed to compile shader \"%s\"\n%s\n", getDebugName().c_str(), std::get<1>(*error).c_str());
@@ -176,16 +182,21 @@ Shader* Shader::ShaderLoader::load(std::tuple<int, std::string>* error)
 			return nullptr;
 		}
 
-		CHECK_F(files->exists(cachePath.c_str()));
+		std::ifstream f(outputPath, std::ios_base::binary);
+		spirv.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+		f.close();
+		DeleteFileA(outputPath.c_str());
+		if (spirv.empty())
+		{
+			*error = { SystemError, stringf("glslangValidator didn't write \"%s\"", outputPath.c_str()) };
+			delete m_shader;
+			m_shader = nullptr;
+			return nullptr;
+		}
+		cache->put(key, StringView(spirv.data(), spirv.data() + spirv.size()));
 	}
 
-	if(!m_cacheFile)
-		m_cacheFile = ResourcePtr<File>(NewPtr, cachePath);
-
-	if (!m_cacheFile.ready(error))
-		return nullptr; // wait for cache file
-
-	m_shader->setCompiled((uint32_t*)m_cacheFile->getContents().c_str(), (int)m_cacheFile->getSize());
+	m_shader->setCompiled((uint32_t*)spirv.data(), (int)spirv.size());
 	return m_shader;
 }
 
@@ -34,7 +34,7 @@ namespace Rendering
 		Shader(Type, const char*);
 		~Shader();
 
-		std::string getCachePath() const;
+		std::string getCachePath() const; // where the compiler writes, see DerivedCache for the compiled code
 		vk::ShaderModule getModule() const;
 
 		void setCode(Type, const char*);
@@ -58,7 +58,6 @@ namespace Rendering
 			Type m_type;
 			std::string m_code;
 
-			ResourcePtr<File> m_cacheFile;
 			Shader* m_shader;
 		};
 		static ShaderLoader* createLoader(Type, const char*);
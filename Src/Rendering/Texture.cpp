@@ -4,9 +4,12 @@
 #include "../Misc/Misc.h"
 #include "../Files/File.h"
 #include "../Files/FileManager.h"
+#include "../Files/CookedAsset.h"
+#include "../Files/DerivedCache.h"
 #include "../Managers/EventManager.h"
 #include "../Generators/TextureGenerator.h"
 #include "../Scripts/ScriptManager.h"
+#include "../Scripts/Markup.h"
 #include "VulkanHelpers.h"
 #include "RenderingDevice.h"
 #include "Unit.h"
@@ -445,6 +448,21 @@ int Texture::getPixelSize() const
 	return m_pixelSize;
 }
 
+std::size_t Texture::getCpuSize() const
+{
+	return m_textureData.capacity();
+}
+
+std::size_t Texture::getGpuSize() const
+{
+	if (m_p->m_memory == VK_NULL_HANDLE)
+		return 0;
+
+	VmaAllocationInfo info;
+	vmaGetAllocationInfo(m_device->getVMA(), m_p->m_memory, &info);
+	return (std::size_t)info.size;
+}
+
 vk::Image Texture::getVkImage() const
 {
 	return m_p->m_image;
@@ -523,8 +541,33 @@ ResourcePtr<Texture> Texture::loadPy(const File& file, const GeneratorArguments*
 	return ResourcePtr<Rendering::Texture>(TakeOwnershipPtr, loadPyRaw(file, args));
 }
 
+Texture* Texture::loadCookedRaw(StringView contents, const std::string& name)
+{
+	typedef CookedAsset::Texture Cooked;
+	const Cooked* cooked = (const Cooked*)CookedAsset::read(contents, CookedAsset::Type::Texture, sizeof(Cooked));
+	if (!cooked)
+		return nullptr;
+
+	std::size_t size = (std::size_t)cooked->m_width * cooked->m_height * cooked->m_pixelSize;
+	if (contents.size() < sizeof(CookedAsset::Header) + sizeof(Cooked) + size)
+	{
+		LOG_F(WARNING, "Cooked texture \"%s\" is truncated\n", name.c_str());
+		return nullptr;
+	}
+
+	Rendering::Texture* texture = new Rendering::Texture();
+	texture->setSoftware(cooked->m_width, cooked->m_height, cooked->m_pixelSize);
+	memcpy(texture->map(), cooked + 1, size);
+	texture->unmap();
+	return texture;
+}
+
 Texture* Texture::loadPngRaw(const File& file)
 {
+	// decoded offline, see AssetCooker
+	if (CookedAsset::read(file.getContents(), CookedAsset::Type::Texture, sizeof(CookedAsset::Texture)))
+		return loadCookedRaw(file.getContents(), file.getPath());
+
 	unsigned char* pixels;
 	unsigned int width, height;
 	int pngerror = lodepng_decode32(&pixels, &width, &height, (const unsigned char*)file.getContents().c_str(), file.getSize());
@@ -546,12 +589,59 @@ Texture* Texture::loadPngRaw(const File& file)
 	}
 }
 
-Texture* Texture::loadPyRaw(const File& file, const GeneratorArguments* args)
+// other modules can change, or hand out random numbers, without the script changing. Junkpile is covered by the generator version
+static bool importsModules(const std::string& script)
 {
+	std::istringstream lines(script);
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		std::istringstream words(line);
+		std::string keyword, module, rest;
+		words >> keyword >> module;
+		std::getline(words, rest);
+		if (keyword == "from" && module != "Junkpile")
+			return true;
+		if (keyword == "import" && (module != "Junkpile" || rest.find_first_not_of(" \t\r") != std::string::npos))
+			return true;
+	}
+	return false;
+}
+
+Texture* Texture::loadPyRaw(const File& file, const GeneratorArguments* args, bool reload)
+{
+	// keyed on the source that runs, bump the version when TextureGenerator changes what a script produces.
+	// Arguments other than the size can't be hashed, those are always generated. Neither are scripts with
+	// markup, their values are edited in the ScriptManager and remarking reloads them
+	const std::uint32_t generatorVersion = 1;
+	Markup markup;
+	markup.parseScript(file.getContents());
+	std::string source = markup.markUp(file.getContents());
+	bool cacheable = (!args || args->m_args.empty()) && !reload && markup.getMarks().empty() && !importsModules(source);
+	std::string parameters = args ? stringf("%dx%d", args->m_requestedWidth, args->m_requestedHeight) : std::string();
+	ResourcePtr<DerivedCache> cache;
+	DerivedCache::Key key = DerivedCache::key("pytexture", generatorVersion, source, parameters);
+
+	std::vector<char> cooked;
+	if (cacheable && cache->get(key, &cooked))
+	{
+		if (Texture* texture = loadCookedRaw(StringView(cooked.data(), cooked.data() + cooked.size()), file.getPath()))
+			return texture;
+	}
+
 	ResourcePtr<ScriptManager> sm;
 	sm->run(file.getPath().c_str(), true);
 	sm->remark(file.getPath().c_str()); // this should be part of run()
-	return TextureGenerator::Instance->generate();
+	Texture* texture = TextureGenerator::Instance->generate();
+
+	if (cacheable && texture && texture->getMode() == Mode::SOFTWARE)
+	{
+		std::vector<char> blob;
+		CookedAsset::writeTexture(file.getContents(), texture->getWidth(), texture->getHeight(), texture->getPixelSize(), (const char*)texture->map(), &blob);
+		texture->unmap();
+		cache->put(key, StringView(blob.data(), blob.data() + blob.size()));
+	}
+	return texture;
 }
 
 Texture::Loader::Loader():
@@ -566,6 +656,7 @@ m_path(path.c_str()),
 m_file(NewPtr, path),
 m_genArgs()
 {
+	dependsOn(m_file);
 }
 
 Texture::Loader::Loader(StringView path, Texture::GeneratorArguments&& args):
@@ -573,7 +664,7 @@ m_path(path.c_str()),
 m_file(NewPtr, path),
 m_genArgs(new Texture::GeneratorArguments(std::move(args)))
 {
-
+	dependsOn(m_file);
 }
 
 Texture::Loader::~Loader()
@@ -585,7 +676,7 @@ Resource* Texture::Loader::load(std::tuple<int, std::string>* error)
 	if (m_path.empty())
 		return new Texture();
 
-	if (!ready(error, m_file))
+	if (!ready(error, m_file) || isCancelled())
 		return nullptr;
 
 	std::string ext = m_path.substr(m_path.find_last_of('.'));
@@ -595,7 +686,7 @@ Resource* Texture::Loader::load(std::tuple<int, std::string>* error)
 	}
 	else if (ext == ".py")
 	{
-		return Texture::loadPyRaw(*m_file, m_genArgs.get());
+		return Texture::loadPyRaw(*m_file, m_genArgs.get(), m_reload);
 	}
 	else
 	{
@@ -608,7 +699,11 @@ Resource* Texture::Loader::load(std::tuple<int, std::string>* error)
 Texture::Reloader* Texture::Loader::createReloader()
 {
 	std::string path = m_path;
-	return new ReloaderOnFileChange(path, [path]() { return new Loader(path); });
+	return new ReloaderOnFileChange(path, [path]() {
+		Loader* loader = new Loader(path);
+		loader->m_reload = true; // edited, or remarked in the ScriptManager, the cache would hand back the old texture
+		return loader;
+	});
 }
 
 std::string Texture::Loader::getDebugName() const
@@ -616,6 +711,11 @@ std::string Texture::Loader::getDebugName() const
 	return m_path;
 }
 
+std::string Texture::Loader::getPrefetchKey() const
+{
+	return m_genArgs ? std::string() : m_path; // generator arguments aren't part of the key
+}
+
 StringView Texture::Loader::getTypeName() const
 {
 	return "Texture";
@@ -643,7 +743,8 @@ std::tuple<bool, std::size_t> Texture::getSharedHash()
 
 std::tuple<bool, std::size_t> Texture::getSharedHash(StringView path)
 {
-	return { true, std::hash<const char*>{}(path.c_str()) };
+	// hash the path itself (not the pointer) so requests from different strings share, mixed with the type so it doesn't match the File
+	return { true, StringId::hash(path) ^ typeid(Texture).hash_code() };
 }
 
 std::tuple<bool, std::size_t> Texture::getSharedHash(StringView path, GeneratorArguments&&)
@@ -45,6 +45,9 @@ namespace Rendering
 		int getPixelSize() const;
 		vk::Image getVkImage() const;
 
+		std::size_t getCpuSize() const override;
+		std::size_t getGpuSize() const override;
+
 		void setSurfaceImage(vk::Image image, VmaAllocation memory);
 		vk::Image getSurfaceImage();
 
@@ -61,7 +64,8 @@ namespace Rendering
 		void createDeviceObjects(Device*);
 
 		static Texture* loadPngRaw(const File&);
-		static Texture* loadPyRaw(const File&, const GeneratorArguments* = nullptr);
+		static Texture* loadCookedRaw(StringView contents, const std::string& name); // nullptr if it isn't a cooked texture
+		static Texture* loadPyRaw(const File&, const GeneratorArguments* = nullptr, bool reload = false);
 
 	protected:
 		Mode m_mode;
@@ -95,11 +99,13 @@ namespace Rendering
 			Reloader* createReloader() override;
 			std::string getDebugName() const override;
 			StringView getTypeName() const override;
+			std::string getPrefetchKey() const override;
 
 		protected:
 			std::string m_path;
 			ResourcePtr<File> m_file;
 			std::shared_ptr<GeneratorArguments> m_genArgs;
+			bool m_reload{ false };
 		};
 
 		static Loader* createLoader();
@@ -46,35 +46,13 @@ void TextureAtlas::layoutAtlas()
 {
 	LOG_IF_F(ERROR, m_mode != Texture::Mode::EMPTY, "Texture Atlas must be empty before laying out");
 
-	auto smallestArea = [](Texture* t1, Texture* t2) {
-		return t1->getWidth() * t1->getHeight() < t2->getWidth() * t2->getHeight();
-	};
+	std::vector<glm::ivec2> sizes;
+	for (Texture* texture : m_textures)
+		sizes.emplace_back(texture->getWidth(), texture->getHeight());
 
-	auto maxElement = std::max_element(m_textures.begin(), m_textures.end(), smallestArea);
-
-	stbrp_rect* rects = (stbrp_rect*)alloca(m_textures.size() * sizeof(stbrp_rect));
-	// subtract one in case we're already a power of 2, we want to keep it
-	int width = nextPowerOf2((*maxElement)->getWidth() - 1), height = nextPowerOf2((*maxElement)->getHeight() - 1);
-	while (true) // find the width/height of our final texture
-	{
-		memset(rects, 0x00, m_textures.size() * sizeof(stbrp_rect));
-		for (int i = 0; i < m_textures.size(); ++i)
-		{
-			rects[i].id = i;
-			rects[i].w = m_textures[i]->getWidth() + m_padding;
-			rects[i].h = m_textures[i]->getHeight() + m_padding;
-		}
-
-		stbrp_node nodes[512];
-		stbrp_context packer;
-		stbrp_init_target(&packer, width, height, nodes, 512);
-		int result = stbrp_pack_rects(&packer, rects, (int)m_textures.size());
-		if (result == 1)
-			break;
-
-		if(width < height)	width = nextPowerOf2(width);
-		else				height = nextPowerOf2(height);
-	}
+	int width, height;
+	std::vector<glm::ivec4> rects;
+	pack(sizes, m_padding, &width, &height, &rects);
 
 	// let's write it into pixels
 	int pixelSize = m_textures[0]->getPixelSize();
@@ -86,19 +64,67 @@ void TextureAtlas::layoutAtlas()
 		Texture* st = m_textures[i];
 		BitBltBuffer d = { pixels, (std::size_t)pixelSize, width, height };
 		BitBltBuffer s = { (char*)st->map(), (std::size_t)st->getPixelSize(), st->getWidth(), st->getHeight() };
-		stbrp_rect* rect = rects + i;
-		bitblt(d, rect->x + halfPadding, rect->y + halfPadding, rect->w - m_padding, rect->h - m_padding, s, 0, 0);
+		const glm::ivec4& rect = rects[i];
+		bitblt(d, rect.x + halfPadding, rect.y + halfPadding, rect.z - m_padding, rect.w - m_padding, s, 0, 0);
 		st->unmap();
 
 		Frame frame;
 		frame.m_id = i;
-		frame.m_uv1 = { (float)rect->x / (float)width, (float)rect->y / (float)height};
-		frame.m_uv2 = { (float)(rect->x + rect->w) / width, (float)(rect->y + rect->h) / (float)height };
+		frame.m_uv1 = { (float)rect.x / (float)width, (float)rect.y / (float)height};
+		frame.m_uv2 = { (float)(rect.x + rect.z) / width, (float)(rect.y + rect.w) / (float)height };
 		m_frames.push_back(std::move(frame));
 	}
 	unmap();
 }
 
+void TextureAtlas::setLayout(int width, int height, int pixelSize, const char* pixels, const std::vector<std::tuple<glm::vec2, glm::vec2>>& uvs)
+{
+	LOG_IF_F(ERROR, m_mode != Texture::Mode::EMPTY, "Texture Atlas must be empty before laying out");
+
+	setSoftware(width, height, pixelSize);
+	memcpy(map(), pixels, (std::size_t)width * height * pixelSize);
+	unmap();
+
+	for (std::size_t i = 0; i < uvs.size(); i++)
+		m_frames.push_back({ (int)i, std::get<0>(uvs[i]), std::get<1>(uvs[i]) });
+}
+
+void TextureAtlas::pack(const std::vector<glm::ivec2>& sizes, unsigned int padding, int* width, int* height, std::vector<glm::ivec4>* result)
+{
+	auto smallestArea = [](const glm::ivec2& s1, const glm::ivec2& s2) {
+		return s1.x * s1.y < s2.x * s2.y;
+	};
+
+	auto maxElement = std::max_element(sizes.begin(), sizes.end(), smallestArea);
+
+	std::vector<stbrp_rect> rects(sizes.size());
+	// subtract one in case we're already a power of 2, we want to keep it
+	*width = nextPowerOf2(maxElement->x - 1), *height = nextPowerOf2(maxElement->y - 1);
+	while (true) // find the width/height of our final texture
+	{
+		memset(rects.data(), 0x00, rects.size() * sizeof(stbrp_rect));
+		for (int i = 0; i < sizes.size(); ++i)
+		{
+			rects[i].id = i;
+			rects[i].w = sizes[i].x + padding;
+			rects[i].h = sizes[i].y + padding;
+		}
+
+		stbrp_node nodes[512];
+		stbrp_context packer;
+		stbrp_init_target(&packer, *width, *height, nodes, 512);
+		if (stbrp_pack_rects(&packer, rects.data(), (int)rects.size()) == 1)
+			break;
+
+		if(*width < *height)	*width = nextPowerOf2(*width);
+		else					*height = nextPowerOf2(*height);
+	}
+
+	result->clear();
+	for (const stbrp_rect& rect : rects)
+		result->emplace_back(rect.x, rect.y, rect.w, rect.h);
+}
+
 std::tuple< glm::vec2, glm::vec2 > TextureAtlas::getUV(int frameId) const
 {
 	if (m_frames.empty())
@@ -17,9 +17,13 @@ namespace Rendering
 		void addSprite(SpriteData*);
 
 		void layoutAtlas();
+		void setLayout(int width, int height, int pixelSize, const char* pixels, const std::vector<std::tuple<glm::vec2, glm::vec2>>& uvs); // packed offline
 
 		std::tuple< glm::vec2, glm::vec2 > getUV(int frameId) const;
 
+		// fits every size plus padding into the smallest power of two texture, rects are x, y, width, height (padding included)
+		static void pack(const std::vector<glm::ivec2>& sizes, unsigned int padding, int* width, int* height, std::vector<glm::ivec4>* rects);
+
 	protected:
 		std::vector<Texture*> m_textures;
 		unsigned int m_padding;
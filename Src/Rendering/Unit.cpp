@@ -14,6 +14,9 @@
 // NOTE: this is very resource intensive
 //#define RECORD_STACK
 
+// fewer draws than this in a run are recorded on the calling thread
+static const std::size_t s_drawsPerBatch = 64;
+
 using namespace Rendering;
 Unit::Unit() :
 m_data(std::make_shared<Data>()),
@@ -53,6 +56,10 @@ Unit::~Unit()
 
 void Unit::submit()
 {
+	// resolved once here, submitAll only has to look the pipeline up
+	if (!m_data->m_hasPipelineKey)
+		createPipelineKey();
+
 	m_data->m_root->m_submitted.push_back(*this);
 	m_submitted = true;
 }
@@ -166,64 +173,66 @@ bool Unit::submitLayoutChange(Rendering::Device* device, vk::CommandBuffer buffe
 	return false;
 }
 
-bool Unit::submitDrawCall(Rendering::Device* device, vk::CommandBuffer buffer, bool clear)
+bool Unit::isTransfer()
 {
+	// the same checks submitCommandBuffers makes before it tries a draw
 	Data& d = getData();
-	Texture* bindTextures[4] = {};
-	Buffer *vertices = nullptr, * indices = nullptr;
-	auto pipelineLayout = getVulkanObject<vk::PipelineLayout>();
-	auto pipeline = getVulkanObject<vk::Pipeline>();
-	auto descriptorSet = getVulkanObject<vk::DescriptorSet>();
-	std::array<vk::Viewport, 1> viewports = { getVulkanObject<vk::Viewport>() };
-	auto scissor = getVulkanObject<vk::Rect2D>();
-	if (!pipeline)
-		return false;
+	bool layoutChange = false;
+	for (Any& any : d.m_settings)
+		layoutChange = layoutChange || any.isType<vk::ImageLayout>();
 
 	for (Any& any : d.m_settings)
 	{
-		if ((bindTextures[0] == nullptr || bindTextures[1] == nullptr || bindTextures[2] == nullptr || bindTextures[3] == nullptr) && any.isType<Binding<ResourcePtr<Texture>>>())
+		Texture* texture = nullptr;
+		if (getResource(texture, any.getPtr<ResourcePtr<Texture>>()) || getResource(texture, any.getPtr<ResourcePtr<TextureAtlas>>()))
 		{
-			auto& binding = any.get<Binding<ResourcePtr<Texture>>>();
-			int stageLocation = binding.m_binding;
-			CHECK_F(stageLocation < countof(bindTextures));
-			CHECK_F(bindTextures[stageLocation] == nullptr);
-			bindTextures[stageLocation] = binding.m_value;
-			continue;
+			if (!d.m_targets.empty() || (layoutChange && texture->getMode() == Texture::Mode::HOST_VISIBLE))
+				return true;
 		}
-		else if ((!vertices || !indices) && any.isType<Named<Buffer*> >())
+		else if (layoutChange && any.isType<vk::Image>())
 		{
-			auto buffer = any.get<Named< Buffer*> >();
-			if (!vertices && buffer.m_value->getType() == Buffer::Type::Vertex) vertices = buffer.m_value;
-			else if (!indices && buffer.m_value->getType() == Buffer::Type::Index) indices = buffer.m_value;
-			continue;
+			return true;
 		}
 	}
 
-	if(!vertices)
-		return false;
-
-	vk::Buffer vBuffer = vertices->getVkBuffer();
-	std::array<vk::DeviceSize, 1> vertexOffset = { 0 };
-	buffer.bindVertexBuffers(0, vBuffer, vertexOffset);
-	if(indices)
-		buffer.bindIndexBuffer(indices->getVkBuffer(), 0, indices->getStride() == 4 ? vk::IndexType::eUint32 : vk::IndexType::eUint16);
+	return false;
+}
 
-	buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
-	buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, std::array<vk::DescriptorSet, 1>{descriptorSet}, std::array<uint32_t, 0>{0});
-	buffer.setViewport(0, viewports);
-	buffer.setScissor(0, std::array<vk::Rect2D, 1>{scissor});
+bool Unit::prepareDrawCall(Rendering::Device* device, DrawCall* draw)
+{
+	Data& d = getData();
+	draw->m_pipeline = getVulkanObject<vk::Pipeline>(); // first, a cache hit fills in the layouts as well
+	if (!draw->m_pipeline)
+		return false;
 
-	std::size_t pushConstantCount = 0;
-	vk::PushConstantRange pushConstantInfo[6] = {};
-	for (Any& any : m_data->m_settings)
+	Buffer *vertices = nullptr, *indices = nullptr, *instances = nullptr;
+	for (Any& any : d.m_settings)
 	{
-		if (any.isType<PushConstant>())
+		if ((!vertices || !indices || !instances) && any.isType<Named<Buffer*> >())
 		{
-			auto& pc = any.get<PushConstant>();
-			buffer.pushConstants(pipelineLayout, pc.m_flags, 0, (uint32_t)pc.m_value.size(), &pc.m_value.front());
+			auto buffer = any.get<Named< Buffer*> >();
+			if (!vertices && buffer.m_value->getType() == Buffer::Type::Vertex) vertices = buffer.m_value;
+			else if (!indices && buffer.m_value->getType() == Buffer::Type::Index) indices = buffer.m_value;
+			else if (!instances && buffer.m_value->getType() == Buffer::Type::Instance) instances = buffer.m_value;
 		}
 	}
 
+	if (!vertices)
+		return false;
+
+	draw->m_pipelineLayout = getVulkanObject<vk::PipelineLayout>();
+	draw->m_descriptorSet = getVulkanObject<vk::DescriptorSet>();
+	draw->m_viewport = getVulkanObject<vk::Viewport>();
+	draw->m_scissor = getVulkanObject<vk::Rect2D>();
+	draw->m_vertexBuffers = { vertices->getVkBuffer(), instances ? instances->getVkBuffer() : vk::Buffer() };
+	draw->m_vertexBufferCount = instances ? 2 : 1;
+	draw->m_indexBuffer = indices ? indices->getVkBuffer() : vk::Buffer();
+	draw->m_indexType = indices && indices->getStride() == 4 ? vk::IndexType::eUint32 : vk::IndexType::eUint16;
+	return true;
+}
+
+void Unit::beginRenderPass(Rendering::Device* device, vk::CommandBuffer buffer, const vk::Rect2D& area, bool clear, vk::SubpassContents contents)
+{
 	vk::RenderPassBeginInfo renderPassInfo;
 	renderPassInfo.renderPass = clear ? device->getClearingRenderPass() : device->getRenderPass();
 	renderPassInfo.framebuffer = std::get<0>(device->getFrameBuffer());
@@ -235,27 +244,61 @@ bool Unit::submitDrawCall(Rendering::Device* device, vk::CommandBuffer buffer, b
 	clearValues[1].depthStencil = depthStencilValue;
 	renderPassInfo.clearValueCount = clear ? 2 : 0;
 	renderPassInfo.pClearValues = clearValues;
+	renderPassInfo.renderArea = area;
+	buffer.beginRenderPass(renderPassInfo, contents);
+}
 
-	//renderPassInfo.clearValueCount = 0;
-	//renderPassInfo.pClearValues = nullptr;
-	renderPassInfo.renderArea = scissor;
-	buffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
-	for (Any& any : m_data->m_settings)
+bool Unit::submitDrawCall(Rendering::Device* device, vk::CommandBuffer buffer, bool clear)
+{
+	DrawCall draw;
+	if (!prepareDrawCall(device, &draw))
+		return false;
+
+	beginRenderPass(device, buffer, draw.m_scissor, clear, vk::SubpassContents::eInline);
+	recordDrawCall(draw, buffer);
+	buffer.endRenderPass();
+	return true;
+}
+
+void Unit::submitDrawCalls(Rendering::Device* device, vk::CommandBuffer buffer, Unit* units, const std::vector<DrawCall>& draws, bool clear)
+{
+	// one render pass for the whole run. Short runs aren't worth the secondary buffers, they're recorded inline
+	ResourcePtr<ThreadPool> pool;
+	std::size_t count = draws.size();
+	std::size_t batches = std::min(pool->getThreadCount() + 1, (count + s_drawsPerBatch - 1) / s_drawsPerBatch);
+
+	// the whole framebuffer, each draw sets its own scissor within it
+	glm::u32vec2 extent = std::get<1>(device->getFrameBuffer());
+	vk::Rect2D area{ { 0, 0 }, { extent.x, extent.y } };
+	if (batches <= 1)
 	{
-		if (any.isType<Draw>())
-		{
-			const Draw& d = any.get<Draw>();
-			buffer.draw(d.m_vertexCount, d.m_instanceCount, d.m_firstVertex, d.m_firstInstance);
-		}
-		else if (any.isType<DrawIndexed>())
-		{
-			const DrawIndexed& d = any.get<DrawIndexed>();
-			buffer.drawIndexed(d.m_indexCount, d.m_instanceCount, d.m_firstIndex, d.m_vertexOffset, d.m_firstInstance);
-		}
+		units[0].beginRenderPass(device, buffer, area, clear, vk::SubpassContents::eInline);
+		for (std::size_t i = 0; i < count; i++)
+			units[i].recordDrawCall(draws[i], buffer);
+		buffer.endRenderPass();
+		return;
 	}
+
+	std::size_t grain = (count + batches - 1) / batches;
+	std::vector<vk::CommandBuffer> secondaries((count + grain - 1) / grain);
+
+	// begun and ended here, the pool threads only record into them
+	vk::CommandBufferInheritanceInfo inheritance(device->getRenderPass(), 0, std::get<0>(device->getFrameBuffer()));
+	vk::CommandBufferBeginInfo beginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue, &inheritance);
+	for (vk::CommandBuffer& secondary : secondaries)
+	{
+		secondary = device->getRecordingBuffer();
+		checkVkResult(secondary.begin(beginInfo));
+	}
+
+	recordDrawCalls(units, draws.data(), count, grain, secondaries.data());
+
+	for (vk::CommandBuffer& secondary : secondaries)
+		secondary.end();
+
+	units[0].beginRenderPass(device, buffer, area, clear, vk::SubpassContents::eSecondaryCommandBuffers);
+	buffer.executeCommands(secondaries);
 	buffer.endRenderPass();
-	
-	return true;
 }
 
 bool Unit::submitClearCall(Rendering::Device* device, vk::CommandBuffer buffer)
@@ -263,8 +306,8 @@ bool Unit::submitClearCall(Rendering::Device* device, vk::CommandBuffer buffer)
 	/*Data& d = getData();
 	Texture* bindTextures[4] = {};
 	Buffer* vertices = nullptr, * indices = nullptr;
+	auto pipeline = getVulkanObject<vk::Pipeline>(); // first, a cache hit fills in the layouts as well
 	auto pipelineLayout = getVulkanObject<vk::PipelineLayout>();
-	auto pipeline = getVulkanObject<vk::Pipeline>();
 	auto descriptorSet = getVulkanObject<vk::DescriptorSet>();*/
 
 	vk::ClearColorValue* clearValue = nullptr;
@@ -331,6 +374,7 @@ Unit& Unit::in(ResourcePtr<TextureAtlas> v) { return _in(v); }
 Unit& Unit::in(Buffer* v) {
 	if (v->getType() == Buffer::Type::Vertex) return _in(Named<Buffer*>("Vertex", v));
 	else if (v->getType() == Buffer::Type::Index)  return _in(Named<Buffer*>("Index", v));
+	else if (v->getType() == Buffer::Type::Instance)  return _in(Named<Buffer*>("Instance", v));
 	else return _in(v);
 }
 Unit& Unit::in(vk::ImageLayout v) { return _in(v); }
@@ -377,4 +421,71 @@ std::vector<Unit>& RootUnit::getSubmitted()
 void Unit::test()
 {
 
-}
\ No newline at end of file
+}
+
+namespace
+{
+	// headless stand in for vk::CommandBuffer, counts what recordDrawCall emits and remembers the draw order
+	struct CountingCommandBuffer
+	{
+		int m_commands{ 0 };
+		std::vector<uint32_t> m_draws; // firstInstance of each draw
+
+		template<typename... Args> void bindVertexBuffers(Args&&...) { m_commands++; }
+		template<typename... Args> void bindIndexBuffer(Args&&...) { m_commands++; }
+		template<typename... Args> void bindPipeline(Args&&...) { m_commands++; }
+		template<typename... Args> void bindDescriptorSets(Args&&...) { m_commands++; }
+		template<typename... Args> void setViewport(Args&&...) { m_commands++; }
+		template<typename... Args> void setScissor(Args&&...) { m_commands++; }
+		template<typename... Args> void pushConstants(Args&&...) { m_commands++; }
+		void draw(uint32_t, uint32_t, uint32_t, uint32_t firstInstance) { m_commands++; m_draws.push_back(firstInstance); }
+		void drawIndexed(uint32_t, uint32_t, uint32_t, int32_t, uint32_t firstInstance) { m_commands++; m_draws.push_back(firstInstance); }
+	};
+}
+
+void Unit::testRecording()
+{
+	// no device objects needed, the draw calls are recorded with null handles
+	const std::size_t count = 20000;
+	std::vector<Unit> units;
+	units.reserve(count);
+	for (std::size_t i = 0; i < count; i++)
+	{
+		units.emplace_back();
+		units.back().in(PushConstant(vk::ShaderStageFlagBits::eVertex, std::vector<char>(64)));
+		units.back().in(Draw(4, 1, 0, (uint32_t)i));
+		if (i % 3 == 0)
+			units.back().in(DrawIndexed(6, 1, 0, 0, (uint32_t)i)); // uneven batches
+	}
+	std::vector<DrawCall> draws(count);
+	for (DrawCall& draw : draws)
+		draw.m_vertexBufferCount = 1;
+
+	CountingCommandBuffer serial;
+	for (std::size_t i = 0; i < count; i++)
+		units[i].recordDrawCall(draws[i], serial);
+
+	ResourcePtr<ThreadPool> pool;
+	for (std::size_t batches = 1; batches <= pool->getThreadCount() + 1; batches++)
+	{
+		std::size_t grain = (count + batches - 1) / batches;
+		std::vector<CountingCommandBuffer> buffers((count + grain - 1) / grain);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		recordDrawCalls(units.data(), draws.data(), count, grain, buffers.data());
+		float ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		// executed in order, the batches have to add up to the serial recording
+		int commands = 0;
+		std::vector<uint32_t> order;
+		for (CountingCommandBuffer& buffer : buffers)
+		{
+			commands += buffer.m_commands;
+			order.insert(order.end(), buffer.m_draws.begin(), buffer.m_draws.end());
+		}
+		CHECK_F(commands == serial.m_commands, "%d batches recorded %d commands instead of %d", (int)batches, commands, serial.m_commands);
+		CHECK_F(order == serial.m_draws, "%d batches changed the draw order", (int)batches);
+
+		LOG_F(INFO, "recordDrawCalls: %d units in %d batches %.2fms (%d commands)\n", (int)count, (int)buffers.size(), ms, commands);
+	}
+}
@@ -6,6 +6,7 @@
 #include "../Misc/Any.h"
 #include "../Misc/ClassMask.h"
 #include "RenderingDevice.h"
+#include "../Threading/ThreadPool.h"
 namespace Rendering
 {
 	class Shader;
@@ -67,6 +68,20 @@ namespace Rendering
 			float minDepthBounds = {};
 			float maxDepthBounds = {};*/
 		};
+
+		// everything a draw records, resolved on the submitting thread so the recording itself can run on any thread
+		struct DrawCall
+		{
+			vk::Pipeline m_pipeline;
+			vk::PipelineLayout m_pipelineLayout;
+			vk::DescriptorSet m_descriptorSet;
+			vk::Viewport m_viewport;
+			vk::Rect2D m_scissor;
+			std::array<vk::Buffer, 2> m_vertexBuffers; // vertices, instances
+			uint32_t m_vertexBufferCount{ 0 };
+			vk::Buffer m_indexBuffer;
+			vk::IndexType m_indexType{ vk::IndexType::eUint16 };
+		};
 		
 	public:
 		Unit();
@@ -106,6 +121,7 @@ namespace Rendering
 		Unit& out(Texture&);
 
 		static void test();
+		static void testRecording();
 
 	protected:
 		struct Data;
@@ -121,6 +137,8 @@ namespace Rendering
 		template<typename T> void opt(T& v, const char* name, const T& defaultValue);
 		template<typename T> void opt(T&, int binding, const T& defaultValue);
 		template<typename T> void getBindings(Data* data, std::vector< vk::DescriptorSetLayoutBinding>* bindings, vk::DescriptorType type);
+		template<typename F> void forEachSetting(Data&, const F&);
+		void createPipelineKey();
 
 		Data& getData();
 
@@ -130,6 +148,12 @@ namespace Rendering
 		bool submitLayoutChange(Rendering::Device* device, vk::CommandBuffer buffer, Texture* texture);
 		bool submitLayoutChange(Rendering::Device* device, vk::CommandBuffer buffer, vk::Image image);
 		bool submitDrawCall(Rendering::Device* device, vk::CommandBuffer buffer, bool clear);
+		bool isTransfer(); // an upload or layout change, submitCommandBuffers records those instead of a draw
+		bool prepareDrawCall(Rendering::Device* device, DrawCall*);
+		void beginRenderPass(Rendering::Device* device, vk::CommandBuffer buffer, const vk::Rect2D& area, bool clear, vk::SubpassContents);
+		template<typename CommandBuffer> void recordDrawCall(const DrawCall&, CommandBuffer&);
+		template<typename CommandBuffer> static void recordDrawCalls(Unit* units, const DrawCall* draws, std::size_t count, std::size_t grain, CommandBuffer* buffers);
+		static void submitDrawCalls(Rendering::Device* device, vk::CommandBuffer buffer, Unit* units, const std::vector<DrawCall>& draws, bool clear);
 		bool submitClearCall(Rendering::Device* device, vk::CommandBuffer buffer);
 
 	protected:
@@ -145,6 +169,8 @@ namespace Rendering
 			vk::DescriptorSet m_descriptorSet;
 			vk::Pipeline m_pipeline;
 			vk::PipelineLayout m_pipelineLayout;
+			PipelineKey m_pipelineKey;
+			bool m_hasPipelineKey{ false };
 			bool m_empty{ true };
 		};
 		std::shared_ptr<Data> m_data;
@@ -243,6 +269,67 @@ namespace Rendering
 			//throw std::runtime_error{ stringf("Failed to find Vulkan variable %s", name ? name : typeid(T).name()) };
 	}
 
+	// binds and draws only, no render pass. CommandBuffer is a vk::CommandBuffer or anything with the same calls
+	template<typename CommandBuffer> void Unit::recordDrawCall(const DrawCall& draw, CommandBuffer& buffer)
+	{
+		// instance data is binding 1, see createVulkanObject<vk::Pipeline>
+		std::array<vk::DeviceSize, 2> vertexOffsets = { 0, 0 };
+		buffer.bindVertexBuffers(0, draw.m_vertexBufferCount, draw.m_vertexBuffers.data(), vertexOffsets.data());
+		if (draw.m_indexBuffer)
+			buffer.bindIndexBuffer(draw.m_indexBuffer, 0, draw.m_indexType);
+
+		buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, draw.m_pipeline);
+		buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, draw.m_pipelineLayout, 0, std::array<vk::DescriptorSet, 1>{draw.m_descriptorSet}, std::array<uint32_t, 0>{});
+		buffer.setViewport(0, std::array<vk::Viewport, 1>{draw.m_viewport});
+		buffer.setScissor(0, std::array<vk::Rect2D, 1>{draw.m_scissor});
+
+		for (Any& any : m_data->m_settings)
+		{
+			if (any.isType<PushConstant>())
+			{
+				auto& pc = any.get<PushConstant>();
+				buffer.pushConstants(draw.m_pipelineLayout, pc.m_flags, 0, (uint32_t)pc.m_value.size(), &pc.m_value.front());
+			}
+		}
+
+		for (Any& any : m_data->m_settings)
+		{
+			if (any.isType<Draw>())
+			{
+				const Draw& d = any.get<Draw>();
+				buffer.draw(d.m_vertexCount, d.m_instanceCount, d.m_firstVertex, d.m_firstInstance);
+			}
+			else if (any.isType<DrawIndexed>())
+			{
+				const DrawIndexed& d = any.get<DrawIndexed>();
+				buffer.drawIndexed(d.m_indexCount, d.m_instanceCount, d.m_firstIndex, d.m_vertexOffset, d.m_firstInstance);
+			}
+		}
+	}
+
+	// units [first, first + grain) go into buffers[first / grain], recorded on the ThreadPool and the calling thread.
+	// Executing the buffers in order gives the same draws in the same order as recording them one by one
+	template<typename CommandBuffer> void Unit::recordDrawCalls(Unit* units, const DrawCall* draws, std::size_t count, std::size_t grain, CommandBuffer* buffers)
+	{
+		ResourcePtr<ThreadPool> pool;
+		pool->parallelFor(count, grain, [units, draws, grain, buffers](std::size_t first, std::size_t n)
+		{
+			CommandBuffer& buffer = buffers[first / grain];
+			for (std::size_t i = first; i < first + n; i++)
+				units[i].recordDrawCall(draws[i], buffer);
+		});
+	}
+
+	// own settings first, then the supers, in the order req()/opt() search them
+	template<typename F> void Unit::forEachSetting(Data& data, const F& f)
+	{
+		for (auto& any : data.m_settings)
+			f(any);
+
+		for (auto& super : data.m_supers)
+			forEachSetting(super.getData(), f);
+	}
+
 	template<typename T> void Unit::req(T& v, const char* name) { reqOrOpt(v, name, true); }
 	template<typename T> void Unit::opt(T& v, const char* name) { reqOrOpt(v, name, false); }
 	template<typename T> void Unit::req(T& v, int binding) { reqOrOpt(v, binding, true); }
@@ -162,10 +162,90 @@ vk::PipelineLayout Unit::createVulkanObject<vk::PipelineLayout>()
     return data.m_pipelineLayout;
 }
 
+void Unit::createPipelineKey()
+{
+    // one pass over everything createVulkanObject<vk::Pipeline> would req()/opt(), first one found wins the same way.
+    // Doesn't longjmp, a Unit without shaders (clears, uploads) just doesn't get a key
+    Data& data = getData();
+    Shader* vertexShader = nullptr, *fragShader = nullptr;
+    Buffer* vertices = nullptr, *instances = nullptr;
+    const vk::PipelineCreateFlags* flags = nullptr;
+    const vk::PrimitiveTopology* topology = nullptr;
+    const vk::PolygonMode* polygonMode = nullptr;
+    const vk::CullModeFlags* cullMode = nullptr;
+    const vk::FrontFace* frontFace = nullptr;
+    const DepthTest* depthTest = nullptr;
+    const float* lineWidth = nullptr;
+    std::vector<std::uint32_t> layout; // descriptor bindings and push constants, then the vertex formats
+    forEachSetting(data, [&](Any& any)
+    {
+        if (auto* shader = any.getPtr<Named<ResourcePtr<Shader>>>())
+        {
+            Shader*& found = strcmp(shader->m_name, "Vertex") == 0 ? vertexShader : fragShader;
+            if (!found)
+                found = shader->m_value.get();
+        }
+        else if (auto* buffer = any.getPtr<Named<Buffer*>>())
+        {
+            if (!vertices && buffer->m_value->getType() == Buffer::Type::Vertex) vertices = buffer->m_value;
+            else if (!instances && buffer->m_value->getType() == Buffer::Type::Instance) instances = buffer->m_value;
+        }
+        else if (auto* v = any.getPtr<vk::PipelineCreateFlags>()) { if (!flags) flags = v; }
+        else if (auto* v = any.getPtr<vk::PrimitiveTopology>()) { if (!topology) topology = v; }
+        else if (auto* v = any.getPtr<vk::PolygonMode>()) { if (!polygonMode) polygonMode = v; }
+        else if (auto* v = any.getPtr<vk::CullModeFlags>()) { if (!cullMode) cullMode = v; }
+        else if (auto* v = any.getPtr<vk::FrontFace>()) { if (!frontFace) frontFace = v; }
+        else if (auto* v = any.getPtr<DepthTest>()) { if (!depthTest) depthTest = v; }
+        else if (auto* v = any.getPtr<Named<float>>()) { if (!lineWidth && strcmp(v->m_name, "lineWidth") == 0) lineWidth = &v->m_value; }
+        else if (auto* b = any.getPtr<Binding<ResourcePtr<Texture>>>()) layout.insert(layout.end(), { 0u, (std::uint32_t)b->m_binding, (std::uint32_t)b->m_flags });
+        else if (auto* b = any.getPtr<Binding<Buffer*>>()) layout.insert(layout.end(), { 1u, (std::uint32_t)b->m_binding, (std::uint32_t)b->m_flags });
+        else if (auto* pc = any.getPtr<PushConstant>()) layout.insert(layout.end(), { 2u, (std::uint32_t)pc->m_flags, (std::uint32_t)pc->m_value.size() });
+    });
+
+    if (!vertexShader || !fragShader || !vertices || !vertexShader->getModule() || !fragShader->getModule())
+        return;
+
+    for (Buffer* buffer : { vertices, instances })
+    {
+        if (!buffer)
+            continue;
+
+        layout.push_back((std::uint32_t)buffer->getStride());
+        for (const Buffer::Format& format : buffer->getFormat())
+            layout.insert(layout.end(), { (std::uint32_t)format.m_format, (std::uint32_t)format.m_size });
+    }
+
+    PipelineKey& key = data.m_pipelineKey;
+    key.m_vertexShader = (VkShaderModule)vertexShader->getModule();
+    key.m_fragShader = (VkShaderModule)fragShader->getModule();
+    key.m_renderPass = (VkRenderPass)m_device->getRenderPass();
+    key.m_layout = generateHash(layout.data(), layout.size() * sizeof(std::uint32_t));
+    key.m_flags = (std::uint32_t)(flags ? *flags : vk::PipelineCreateFlags());
+    key.m_topology = (std::uint32_t)(topology ? *topology : vk::PrimitiveTopology::eTriangleStrip);
+    key.m_polygonMode = (std::uint32_t)(polygonMode ? *polygonMode : vk::PolygonMode::eFill);
+    key.m_cullMode = (std::uint32_t)(cullMode ? *cullMode : vk::CullModeFlagBits::eBack) | ((std::uint32_t)(frontFace ? *frontFace : vk::FrontFace::eCounterClockwise) << 8);
+    if (depthTest && (depthTest->m_depthTestEnable || depthTest->m_depthWriteEnable))
+        key.m_depth = 1 | (depthTest->m_depthTestEnable ? 2 : 0) | (depthTest->m_depthWriteEnable ? 4 : 0) | ((std::uint32_t)depthTest->m_depthCompareOp << 3);
+    key.m_lineWidth = lineWidth ? *lineWidth : 1.0f;
+    key.computeHash();
+    data.m_hasPipelineKey = true;
+}
+
 template<>
 vk::Pipeline Unit::createVulkanObject<vk::Pipeline>()
 {
     Data& data = getData();
+
+    // the render pass can be recreated between submit() and submitAll()
+    bool keyed = data.m_hasPipelineKey && data.m_pipelineKey.m_renderPass == (VkRenderPass)m_device->getRenderPass();
+    PipelineObjects cached;
+    if (!data.m_pipeline && keyed && m_device->findPipeline(data.m_pipelineKey, &cached))
+    {
+        data.m_pipeline = cached.m_pipeline;
+        if (!data.m_pipelineLayout) data.m_pipelineLayout = cached.m_layout;
+        if (!data.m_descriptorSetLayout) data.m_descriptorSetLayout = cached.m_setLayout;
+    }
+
     if (!data.m_pipeline)
     {
         vk::GraphicsPipelineCreateInfo info;
@@ -217,30 +297,45 @@ vk::Pipeline Unit::createVulkanObject<vk::Pipeline>()
         dynamicState.pDynamicStates = dynamicStates;
         info.pDynamicState = &dynamicState;
 
-        Buffer *vBuffer = nullptr, *iBuffer = nullptr;
+        Buffer *vBuffer = nullptr, *iBuffer = nullptr, *instanceBuffer = nullptr;
         req(vBuffer, "Vertex");
         opt(iBuffer, "Index");
+        opt(instanceBuffer, "Instance");
+
+        // per vertex data is binding 0, per instance data binding 1 with its locations following the vertex ones
+        Buffer* bindingBuffers[2] = { vBuffer, instanceBuffer };
+        uint32_t bindingCount = instanceBuffer ? 2 : 1;
+        vk::VertexInputBindingDescription vertexBinding[2] = {};
+        std::size_t attributeCount = 0;
+        for (uint32_t b = 0; b < bindingCount; b++)
+        {
+            vertexBinding[b].binding = b;
+            vertexBinding[b].stride = (uint32_t)bindingBuffers[b]->getStride();
+            vertexBinding[b].inputRate = b == 0 ? vk::VertexInputRate::eVertex : vk::VertexInputRate::eInstance;
+            attributeCount += bindingBuffers[b]->getFormat().size();
+        }
 
-        vk::VertexInputBindingDescription vertexBinding[1] = {};
-        vertexBinding[0].stride = (uint32_t)vBuffer->getStride();
-        vertexBinding[0].inputRate = vk::VertexInputRate::eVertex;
-
-        const std::vector<Buffer::Format>& vertexFormat = vBuffer->getFormat();
-        vk::VertexInputAttributeDescription* vertexAttributes = (vk::VertexInputAttributeDescription*)alloca(sizeof(vk::VertexInputAttributeDescription) * vertexFormat.size());
-        uint32_t offset = 0;
-        for (std::size_t i = 0; i < vertexFormat.size(); i++)
+        vk::VertexInputAttributeDescription* vertexAttributes = (vk::VertexInputAttributeDescription*)alloca(sizeof(vk::VertexInputAttributeDescription) * attributeCount);
+        uint32_t location = 0;
+        for (uint32_t b = 0; b < bindingCount; b++)
         {
-            vertexAttributes[i].location = (uint32_t)i;
-            vertexAttributes[i].binding = vertexBinding[0].binding;
-            vertexAttributes[i].format = vertexFormat[i].m_format;
-            vertexAttributes[i].offset = offset;
-            offset += (uint32_t)vertexFormat[i].m_size;
+            const std::vector<Buffer::Format>& vertexFormat = bindingBuffers[b]->getFormat();
+            uint32_t offset = 0;
+            for (std::size_t i = 0; i < vertexFormat.size(); i++, location++)
+            {
+                vertexAttributes[location] = vk::VertexInputAttributeDescription();
+                vertexAttributes[location].location = location;
+                vertexAttributes[location].binding = b;
+                vertexAttributes[location].format = vertexFormat[i].m_format;
+                vertexAttributes[location].offset = offset;
+                offset += (uint32_t)vertexFormat[i].m_size;
+            }
         }
 
         vk::PipelineVertexInputStateCreateInfo vertexInfo = {};
-        vertexInfo.vertexBindingDescriptionCount = 1;
+        vertexInfo.vertexBindingDescriptionCount = bindingCount;
         vertexInfo.pVertexBindingDescriptions = vertexBinding;
-        vertexInfo.vertexAttributeDescriptionCount = (uint32_t)vertexFormat.size();
+        vertexInfo.vertexAttributeDescriptionCount = (uint32_t)attributeCount;
         vertexInfo.pVertexAttributeDescriptions = vertexAttributes;
         info.pVertexInputState = &vertexInfo;
 
@@ -296,6 +391,8 @@ vk::Pipeline Unit::createVulkanObject<vk::Pipeline>()
         int32_t basePipelineIndex = {};*/
 
         data.m_pipeline = m_device->createObject(info);
+        if (keyed)
+            m_device->addPipeline(data.m_pipelineKey, { data.m_pipeline, data.m_pipelineLayout, data.m_descriptorSetLayout });
     }
 	return data.m_pipeline;
 }
@@ -0,0 +1,252 @@
+#include "stdafx.h"
+#include "LoadTelemetry.h"
+#include "../Misc/Misc.h"
+
+static const char* outcomeName(LoadTelemetry::Outcome outcome)
+{
+	switch (outcome)
+	{
+	case LoadTelemetry::Outcome::Loaded: return "loaded";
+	case LoadTelemetry::Outcome::Failed: return "failed";
+	case LoadTelemetry::Outcome::Cancelled: return "cancelled";
+	}
+	return "";
+}
+
+static std::string jsonString(const std::string& s)
+{
+	std::string result = "\"";
+	for (char c : s)
+	{
+		if (c == '"' || c == '\\') { result += '\\'; result += c; }
+		else if (c == '\n') result += "\\n";
+		else if ((unsigned char)c < 0x20) result += stringf("\\u%04x", c);
+		else result += c;
+	}
+	return result + "\"";
+}
+
+static void writeLoad(std::ofstream& f, const LoadTelemetry::Load& load, bool comma)
+{
+	f << (comma ? ",\n" : "\n") << "\t\t{\"name\": " << jsonString(load.m_name) << ", \"type\": " << jsonString(load.m_type);
+	f << stringf(", \"outcome\": \"%s\", \"reload\": %s, \"queuedMs\": %.3f, \"loadMs\": %.3f, \"requeues\": %d, \"bytesRead\": %zu, \"thread\": %d, \"requestedMs\": %.3f, \"finishedMs\": %.3f, \"dependencies\": [",
+		outcomeName(load.m_outcome), load.m_reload ? "true" : "false", load.m_queuedMs, load.m_loadMs, load.m_requeues, load.m_bytesRead, load.m_thread, load.m_requestedMs, load.m_finishedMs);
+	for (std::size_t d = 0; d < load.m_dependencies.size(); d++)
+		f << (d > 0 ? ", " : "") << load.m_dependencies[d];
+	f << "]}";
+}
+
+LoadTelemetry::LoadTelemetry():
+m_start(Clock::now())
+{
+
+}
+
+float LoadTelemetry::toMs(Clock::time_point t) const
+{
+	return std::chrono::duration<float, std::milli>(t - m_start).count();
+}
+
+void LoadTelemetry::record(const ResourceData* data, Load&& load, const std::vector<ResourceData*>& dependencies)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	load.m_thread = getThreadIndex(std::this_thread::get_id());
+	bool startup = m_startupMs < 0.0f;
+	for (ResourceData* dependency : dependencies)
+	{
+		auto it = m_lastLoad.find(dependency);
+		if (startup && it != m_lastLoad.end())
+			load.m_dependencies.push_back(it->second);
+	}
+
+	TypeStats& stats = m_types[load.m_type];
+	stats.m_count++;
+	stats.m_failed += load.m_outcome == Outcome::Failed;
+	stats.m_cancelled += load.m_outcome == Outcome::Cancelled;
+	stats.m_reloads += load.m_reload;
+	stats.m_requeues += load.m_requeues;
+	stats.m_queuedMs += load.m_queuedMs;
+	stats.m_loadMs += load.m_loadMs;
+	stats.m_maxLoadMs = std::max(stats.m_maxLoadMs, load.m_loadMs);
+	stats.m_bytesRead += load.m_bytesRead;
+
+	if (startup)
+	{
+		m_lastLoad[data] = m_loads.size();
+		m_loads.push_back(std::move(load));
+	}
+	else
+	{
+		// only the startup loads take part in the critical path, later ones are kept for a look in the json
+		m_recentLoads.push_back(std::move(load));
+		if (m_recentLoads.size() > MaxRecentLoads)
+			m_recentLoads.pop_front();
+	}
+}
+
+void LoadTelemetry::forget(const ResourceData* data)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	m_lastLoad.erase(data);
+}
+
+bool LoadTelemetry::isStartupDone() const
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	return m_startupMs >= 0.0f;
+}
+
+void LoadTelemetry::endStartup()
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	if (m_startupMs < 0.0f)
+	{
+		m_startupMs = toMs(Clock::now());
+		m_criticalPath = getCriticalPath(m_startupMs);
+		m_lastLoad.clear(); // only needed to link up startup dependencies
+	}
+}
+
+std::vector<std::size_t> LoadTelemetry::getStartupCriticalPath() const
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	return m_startupMs >= 0.0f ? m_criticalPath : getCriticalPath(std::numeric_limits<float>::max());
+}
+
+std::vector<std::size_t> LoadTelemetry::getCriticalPath(float endMs) const
+{
+	// m_mutex must be locked
+	// the last load to finish, then whichever of its dependencies finished last, and so on
+	std::vector<std::size_t> path;
+	std::size_t current = m_loads.size();
+	for (std::size_t i = 0; i < m_loads.size(); i++)
+	{
+		const Load& load = m_loads[i];
+		if (!load.m_reload && load.m_finishedMs <= endMs && (current == m_loads.size() || load.m_finishedMs > m_loads[current].m_finishedMs))
+			current = i;
+	}
+
+	while (current != m_loads.size())
+	{
+		path.push_back(current);
+
+		std::size_t next = m_loads.size();
+		for (std::size_t dependency : m_loads[current].m_dependencies)
+		{
+			if (next == m_loads.size() || m_loads[dependency].m_finishedMs > m_loads[next].m_finishedMs)
+				next = dependency;
+		}
+		current = next;
+	}
+
+	std::reverse(path.begin(), path.end());
+	return path;
+}
+
+int LoadTelemetry::getThreadIndex(std::thread::id id)
+{
+	// m_mutex must be locked
+	auto it = std::find(m_threads.begin(), m_threads.end(), id);
+	if (it != m_threads.end())
+		return (int)(it - m_threads.begin());
+
+	m_threads.push_back(id);
+	return (int)m_threads.size() - 1;
+}
+
+bool LoadTelemetry::dumpJson(StringView path) const
+{
+	std::ofstream f(path.c_str(), std::ios_base::trunc);
+	if (!f.is_open())
+	{
+		LOG_F(ERROR, "Unable to write load telemetry to \"%s\"\n", path.c_str());
+		return false;
+	}
+
+	std::lock_guard<std::mutex> l(m_mutex);
+	f << "{\n";
+	f << stringf("\t\"startupMs\": %.3f,\n", m_startupMs);
+
+	f << "\t\"types\": {";
+	bool first = true;
+	for (const auto& type : m_types)
+	{
+		const TypeStats& s = type.second;
+		f << (first ? "\n" : ",\n") << "\t\t" << jsonString(type.first) << ": ";
+		f << stringf("{\"count\": %d, \"failed\": %d, \"cancelled\": %d, \"reloads\": %d, \"requeues\": %d, \"queuedMs\": %.3f, \"loadMs\": %.3f, \"maxLoadMs\": %.3f, \"bytesRead\": %zu}",
+			s.m_count, s.m_failed, s.m_cancelled, s.m_reloads, s.m_requeues, s.m_queuedMs, s.m_loadMs, s.m_maxLoadMs, s.m_bytesRead);
+		first = false;
+	}
+	f << "\n\t},\n";
+
+	f << "\t\"criticalPath\": [";
+	std::vector<std::size_t> criticalPath = m_startupMs >= 0.0f ? m_criticalPath : getCriticalPath(std::numeric_limits<float>::max());
+	for (std::size_t i = 0; i < criticalPath.size(); i++)
+		f << (i > 0 ? ", " : "") << criticalPath[i];
+	f << "],\n";
+
+	f << "\t\"loads\": [";
+	for (std::size_t i = 0; i < m_loads.size(); i++)
+		writeLoad(f, m_loads[i], i > 0);
+	f << "\n\t],\n";
+
+	f << "\t\"recentLoads\": [";
+	for (std::size_t i = 0; i < m_recentLoads.size(); i++)
+		writeLoad(f, m_recentLoads[i], i > 0);
+	f << "\n\t]\n}\n";
+	return true;
+}
+
+void LoadTelemetry::imgui()
+{
+	using namespace ImGui;
+	if (!TreeNode("Load Telemetry"))
+		return;
+
+	if (Button("Dump JSON"))
+		dumpJson("load_telemetry.json");
+
+	std::lock_guard<std::mutex> l(m_mutex);
+	if (m_startupMs >= 0.0f)
+		Text("Startup loading finished after %.1fms, %d loads (%d recent kept)", m_startupMs, (int)m_loads.size(), (int)m_recentLoads.size());
+	else
+		Text("Starting up, %d loads", (int)m_loads.size());
+
+	Columns(9);
+	Separator();
+	Text("Type"); NextColumn();
+	Text("Loads"); NextColumn();
+	Text("Failed/Cancelled"); NextColumn();
+	Text("Reloads"); NextColumn();
+	Text("Requeues"); NextColumn();
+	Text("Queued (avg)"); NextColumn();
+	Text("Load (avg)"); NextColumn();
+	Text("Load (max)"); NextColumn();
+	Text("Read"); NextColumn();
+	Separator();
+	for (const auto& type : m_types)
+	{
+		const TypeStats& s = type.second;
+		float count = (float)std::max(s.m_count, 1);
+		Text("%s", type.first.c_str()); NextColumn();
+		Text("%d", s.m_count); NextColumn();
+		Text("%d/%d", s.m_failed, s.m_cancelled); NextColumn();
+		Text("%d", s.m_reloads); NextColumn();
+		Text("%d", s.m_requeues); NextColumn();
+		Text("%.2fms", s.m_queuedMs / count); NextColumn();
+		Text("%.2fms", s.m_loadMs / count); NextColumn();
+		Text("%.2fms", s.m_maxLoadMs); NextColumn();
+		Text("%s", prettySize(s.m_bytesRead).c_str()); NextColumn();
+	}
+	Columns(1);
+	Separator();
+
+	Text("Startup critical path:");
+	for (std::size_t i : m_startupMs >= 0.0f ? m_criticalPath : getCriticalPath(std::numeric_limits<float>::max()))
+	{
+		const Load& load = m_loads[i];
+		Text("  %8.1fms %s (%s) queued %.2fms, loaded %.2fms on thread %d", load.m_finishedMs, load.m_name.c_str(), load.m_type.c_str(), load.m_queuedMs, load.m_loadMs, load.m_thread);
+	}
+
+	TreePop();
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../Misc/StringView.h"
+
+struct ResourceData;
+
+// timings of every resource load, aggregated per loader type (Loader::getTypeName)
+class LoadTelemetry
+{
+public:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	enum class Outcome
+	{
+		Loaded,
+		Failed,
+		Cancelled
+	};
+
+	struct Load
+	{
+		std::string m_name;
+		std::string m_type;
+		Outcome m_outcome{ Outcome::Loaded };
+		bool m_reload{ false };
+		float m_queuedMs{ 0.0f }; // in a queue or waiting on dependencies
+		float m_loadMs{ 0.0f }; // inside Loader::load, every attempt
+		int m_requeues{ 0 };
+		std::size_t m_bytesRead{ 0 };
+		int m_thread{ -1 };
+		float m_requestedMs{ 0.0f }, m_finishedMs{ 0.0f }; // since the resource manager was created
+		std::vector<std::size_t> m_dependencies; // indices of the loads it waited on
+	};
+
+	struct TypeStats
+	{
+		int m_count{ 0 }, m_failed{ 0 }, m_cancelled{ 0 }, m_reloads{ 0 }, m_requeues{ 0 };
+		float m_queuedMs{ 0.0f }, m_loadMs{ 0.0f }, m_maxLoadMs{ 0.0f };
+		std::size_t m_bytesRead{ 0 };
+	};
+
+public:
+	LoadTelemetry();
+
+	float toMs(Clock::time_point) const;
+
+	// dependencies are the ResourceData the loader declared with dependsOn()
+	void record(const ResourceData*, Load&&, const std::vector<ResourceData*>& dependencies);
+	void forget(const ResourceData*); // freed, the address might get reused
+
+	bool isStartupDone() const;
+	void endStartup();
+	std::vector<std::size_t> getStartupCriticalPath() const;
+
+	bool dumpJson(StringView path) const;
+	void imgui();
+
+protected:
+	std::vector<std::size_t> getCriticalPath(float endMs) const;
+	int getThreadIndex(std::thread::id);
+
+protected:
+	mutable std::mutex m_mutex;
+	Clock::time_point m_start;
+	float m_startupMs{ -1.0f }; // when the loaders first went idle
+
+	std::vector<Load> m_loads; // until startup is done, fixed after that
+	std::vector<std::size_t> m_criticalPath; // of m_loads, set by endStartup()
+	std::deque<Load> m_recentLoads; // after startup, only the last MaxRecentLoads so streaming and reloads don't grow it
+	static const std::size_t MaxRecentLoads = 256;
+	std::map<std::string, TypeStats> m_types;
+	std::unordered_map<const ResourceData*, std::size_t> m_lastLoad; // into m_loads, startup only
+	std::vector<std::thread::id> m_threads;
+};
@@ -6,16 +6,21 @@
 #include "../Managers/EventManager.h"
 #include "../Files/FileManager.h"
 #include "../Scripts/ScriptManager.h"
+#include "../Misc/Misc.h"
+#include "../Misc/StringId.h"
 
 NewPtr_t NewPtr;
 EmptyPtr_t EmptyPtr;
 NoOwnershipPtr_t NoOwnershipPtr;
 TakeOwnershipPtr_t TakeOwnershipPtr;
 ResourceManager* g_resourceManager = nullptr;
+static const float s_releaseCollectMs = 0.25f; // what release() may spend freeing when setFreeResources() is on, collect() gets the rest
+thread_local LoadPriority ResourceManager::s_defaultPriority = LoadPriority::Normal;
 ResourceManager::ResourceManager():
 m_resources(),
 m_threadPool(EmptyPtr),
 m_tasksInProgress(0),
+m_loadersRunning(0),
 m_autoStartTasks(false)
 {
 	CHECK_F(g_resourceManager == nullptr);
@@ -27,22 +32,36 @@ m_autoStartTasks(false)
 ResourceManager::~ResourceManager()
 {
 	setFreeResources(true);
-	while (m_tasksInProgress > 0)
-		;
 
-	while (!m_loadingTasks.empty())
+	std::array<std::deque<Task>, (std::size_t)LoadPriority::Count> loadingTasks;
+	std::vector<Task> deferredTasks;
+	std::list<Task> waitingTasks;
 	{
-		m_loadingTasks.front().m_loader = nullptr;
-		m_loadingTasks.pop();
+		std::unique_lock<std::mutex> l(m_loadingTaskMutex);
+		m_stopLoading = true;
+		m_loadingCondition.notify_all();
+		m_loadingCondition.wait(l, [this]() { return m_loadersRunning == 0; });
+
+		std::swap(loadingTasks, m_loadingTasks);
+		std::swap(deferredTasks, m_deferredTasks);
+		std::swap(waitingTasks, m_waitingTasks);
+		m_dependents.clear();
 	}
 
+	// free the loaders outside of the lock, they release their own ResourcePtrs
+	for (auto& tasks : loadingTasks)
+		tasks.clear();
+	deferredTasks.clear();
+	waitingTasks.clear();
+
 	m_threadPool.release();
 	freeUnreferenced(true);
-	for (auto& resource : m_resources)
-	{
+	m_resources.forEach([](const ResourceData& resource) {
 		if(!resource.m_singleton)
-			LOG_F(WARNING, "Resource (%s) not freed, still has %d references\n", resource.m_debugName.c_str(), resource.m_refCount);
-	}
+			LOG_F(WARNING, "Resource (%s) not freed, still has %d references\n", resource.m_debugName.c_str(), resource.m_refCount.load());
+	});
+	m_freeCandidates.clear();
+	m_shared.clear();
 	m_resources.clear();
 }
 
@@ -54,86 +73,354 @@ void ResourceManager::init()
 
 void ResourceManager::startLoading()
 {
-	auto loader = [](void* ud) {
-		ResourceManager* rm = (ResourceManager*)ud;
-		ResourceManager::Task task;
+	ThreadPool* pool = m_threadPool.get();
+	unsigned int threadCount = (unsigned int)pool->getThreadCount();
+	unsigned int running = m_loadersRunning;
+	while (running < threadCount)
+	{
+		if (m_loadersRunning.compare_exchange_weak(running, running + 1))
+		{
+			pool->enqueue([this]() { loaderLoop(); });
+			running++;
+		}
+	}
+}
 
-		while(true)
+void ResourceManager::loaderLoop()
+{
+	while (true)
+	{
+		Task task;
 		{
+			std::unique_lock<std::mutex> l(m_loadingTaskMutex);
+			while (m_stopLoading || !popTask(&task))
 			{
-				std::lock_guard<std::mutex> l(rm->m_loadingTaskMutex);
-				if (rm->m_loadingTasks.empty())
+				if (m_stopLoading || (m_tasksInProgress == 0 && m_deferredTasks.empty()))
 				{
-					if (rm->m_tasksInProgress > 0)	continue;
-					else							break;
+					// nothing left to do, give the thread back to the pool
+					m_loadersRunning--;
+					m_loadingCondition.notify_all();
+					return;
 				}
-				task = rm->m_loadingTasks.front();
-				rm->m_loadingTasks.pop();
+
+				// deferred tasks wake up when another resource finishes, the timeout covers
+				// dependencies that get resolved outside of the loaders (ie. on the main thread)
+				if (m_loadingCondition.wait_for(l, std::chrono::milliseconds(10)) == std::cv_status::timeout && m_tasksInProgress == 0)
+					wakeDeferredTasks();
 			}
 
-			rm->m_tasksInProgress++;
+			m_tasksInProgress++;
+		}
+
+		// released while it was queued, don't bother loading it
+		if (cancelTask(task))
+		{
+			m_tasksInProgress--;
+			m_loadingCondition.notify_all();
+			continue;
+		}
+
+		{
+			std::lock_guard<std::recursive_mutex> l(task.m_data->m_mutex);
+			task.m_data->m_state = ResourceData::State::LOADING;
+			task.m_reload = task.m_data->m_resource != nullptr;
+		}
+
+		task.m_loader->m_data = task.m_data;
+		std::tuple<int, std::string> errors;
+		auto loadStart = LoadTelemetry::Clock::now();
+		Resource* resource = task.m_loader->load(&errors);
+		task.m_loadMs += std::chrono::duration<float, std::milli>(LoadTelemetry::Clock::now() - loadStart).count();
 
+		if (resource)
+			recordLoad(task, LoadTelemetry::Outcome::Loaded);
+		else if (std::get<int>(errors) != 0)
+			recordLoad(task, LoadTelemetry::Outcome::Failed);
+		else
+			task.m_requeues++;
+		if (resource)
+		{
+			// Resource Loaded
+			std::lock_guard<std::recursive_mutex> l1(m_resourceMutex);
+			std::lock_guard<std::recursive_mutex> l2(task.m_data->m_mutex);
+			if (task.m_data->m_resource)
 			{
-				std::lock_guard<std::recursive_mutex> l(task.m_data->m_mutex);
-				task.m_data->m_state = ResourceData::State::LOADING;
+				task.m_data->m_state = ResourceData::State::LOADED; // use a specific reload state instead?
+				task.m_data->m_reloadedResource = resource;
 			}
-
-			std::tuple<int, std::string> errors;
-			Resource* resource = task.m_loader->load(&errors);
-			if (resource)
+			else
 			{
-				// Resource Loaded
-				std::lock_guard<std::recursive_mutex> l1(rm->m_resourceMutex);
-				std::lock_guard<std::recursive_mutex> l2(task.m_data->m_mutex);
-				if (task.m_data->m_resource)
-				{
-					task.m_data->m_state = ResourceData::State::LOADED; // use a specific reload state instead?
-					task.m_data->m_reloadedResource = resource;
-				}
-				else
-				{
-					task.m_data->m_state = ResourceData::State::LOADED;
-					task.m_data->m_resource = resource;
-				}
-
-				rm->m_notificationQueue.emplace_back(task.m_data, task.m_data->m_state, task.m_loader);
+				task.m_data->m_state = ResourceData::State::LOADED;
+				task.m_data->m_resource = resource;
 			}
-			else if (std::get<int>(errors) != 0)
+
+			m_notificationQueue.emplace_back(task.m_data, task.m_data->m_state, task.m_loader);
+			task.m_data->m_pendingNotifications++;
+		}
+		else if (std::get<int>(errors) != 0)
+		{
+			// Failed to load resource
+			std::lock_guard<std::recursive_mutex> l1(m_resourceMutex);
+			std::lock_guard<std::recursive_mutex> l2(task.m_data->m_mutex);
+			task.m_data->m_state = ResourceData::State::FAILED;
+			task.m_data->m_error = errors;
+			task.m_loader = nullptr;
+
+			m_notificationQueue.emplace_back(task.m_data, task.m_data->m_state);
+			task.m_data->m_pendingNotifications++;
+		}
+
+		bool finished = resource || std::get<int>(errors) != 0;
+		if (!finished)
+		{
+			std::lock_guard<std::recursive_mutex> l(task.m_data->m_mutex);
+			task.m_data->m_state = ResourceData::State::WAITING;
+		}
+
+		// released while loading, the loader might've noticed (Loader::isCancelled) and given up
+		if (!finished && cancelTask(task))
+		{
+			m_tasksInProgress--;
+			m_loadingCondition.notify_all();
+			continue;
+		}
+
+		{
+			std::lock_guard<std::mutex> l(m_loadingTaskMutex);
+			if (finished)
 			{
-				// Failed to load resource
-				std::lock_guard<std::recursive_mutex> l1(rm->m_resourceMutex);
-				std::lock_guard<std::recursive_mutex> l2(task.m_data->m_mutex);
-				task.m_data->m_state = ResourceData::State::FAILED;
-				task.m_data->m_error = errors;
-				task.m_loader = nullptr;
-
-				rm->m_notificationQueue.emplace_back(task.m_data, task.m_data->m_state);
+				resolveDependents(task.m_data);
+
+				// anything that didn't declare its dependencies might've been waiting on this
+				wakeDeferredTasks();
 			}
 			else
 			{
-				// push back into queue
-				std::lock(rm->m_loadingTaskMutex, task.m_data->m_mutex);
-				std::lock_guard<std::mutex> l1(rm->m_loadingTaskMutex, std::adopt_lock_t{});
-				std::lock_guard<std::recursive_mutex> l2(task.m_data->m_mutex, std::adopt_lock_t{});
-
-				task.m_data->m_state = ResourceData::State::WAITING;
-				rm->m_loadingTasks.push(task);
+				// not ready, wait on whatever it depends on or sleep until something else finishes
+				if (!waitOnDependencies(task))
+					m_deferredTasks.push_back(std::move(task));
 			}
 
-			rm->m_tasksInProgress--;
+			m_tasksInProgress--;
 		}
-	};
+		m_loadingCondition.notify_all();
+	}
+}
 
-	ThreadPool* pool = m_threadPool.get();
-	for (std::size_t i = 0; i < pool->getThreadCount(); ++i)
+bool ResourceManager::isLoading() const
+{
+	if (m_tasksInProgress > 0)
+		return true;
+
+	std::lock_guard<std::mutex> l(m_loadingTaskMutex);
+	for (const auto& tasks : m_loadingTasks)
+		if (!tasks.empty())
+			return true;
+
+	return !m_deferredTasks.empty() || !m_waitingTasks.empty();
+}
+
+void ResourceManager::setPriority(ResourceData* data, LoadPriority priority)
+{
+	std::lock_guard<std::mutex> l(m_loadingTaskMutex);
+	LoadPriority previous = data->m_priority;
+	if (previous == priority)
+		return;
+
+	data->m_priority = priority;
+
+	// move it if it's already queued, deferred tasks pick up the new priority when they wake
+	auto& from = m_loadingTasks[(std::size_t)previous];
+	auto it = std::find_if(from.begin(), from.end(), [=](const Task& t) { return t.m_data == data; });
+	if (it != from.end())
 	{
-		pool->enqueue(loader, (void*)this);
+		Task task = std::move(*it);
+		from.erase(it);
+		m_loadingTasks[(std::size_t)priority].push_back(std::move(task));
 	}
 }
 
-bool ResourceManager::isLoading() const
+void ResourceManager::pushTask(Task&& task)
+{
+	{
+		std::lock_guard<std::mutex> l(m_loadingTaskMutex);
+		if (waitOnDependencies(task))
+			return;
+
+		m_loadingTasks[(std::size_t)task.m_data->m_priority].push_back(std::move(task));
+	}
+	m_loadingCondition.notify_one();
+}
+
+bool ResourceManager::waitOnDependencies(Task& task)
+{
+	// m_loadingTaskMutex must be locked
+	std::vector<ResourceData*> pending;
+	for (ResourceData* dependency : task.m_loader->m_dependencies)
+	{
+		std::lock_guard<std::recursive_mutex> l(dependency->m_mutex);
+		if (dependency->m_resource == nullptr && dependency->m_state != ResourceData::State::FAILED && dependency->m_state != ResourceData::State::CANCELLED && dependency->m_state != ResourceData::State::UNMANAGED)
+			pending.push_back(dependency);
+	}
+
+	if (pending.empty())
+		return false;
+
+	// continuation, goes back into the queue when the last dependency resolves
+	task.m_pendingDependencies = (int)pending.size();
+	auto it = m_waitingTasks.insert(m_waitingTasks.end(), std::move(task));
+	for (ResourceData* dependency : pending)
+		m_dependents[dependency].push_back(it);
+
+	return true;
+}
+
+bool ResourceManager::takeQueuedTask(ResourceHandle handle, Task* task)
+{
+	// by handle, the slot may have been freed and reused since the caller looked at it.
+	// A queued task keeps its slot alive, so comparing against the tasks' own data is safe
+	std::lock_guard<std::mutex> l(m_loadingTaskMutex);
+	auto matches = [handle](const Task& t) { return t.m_data->m_handle == handle; };
+
+	for (auto& queued : m_loadingTasks)
+	{
+		auto it = std::find_if(queued.begin(), queued.end(), matches);
+		if (it != queued.end())
+		{
+			*task = std::move(*it);
+			queued.erase(it);
+			return true;
+		}
+	}
+
+	auto deferred = std::find_if(m_deferredTasks.begin(), m_deferredTasks.end(), matches);
+	if (deferred != m_deferredTasks.end())
+	{
+		*task = std::move(*deferred);
+		m_deferredTasks.erase(deferred);
+		return true;
+	}
+
+	auto waiting = std::find_if(m_waitingTasks.begin(), m_waitingTasks.end(), matches);
+	if (waiting != m_waitingTasks.end())
+	{
+		for (ResourceData* dependency : waiting->m_loader->m_dependencies)
+		{
+			auto dependents = m_dependents.find(dependency);
+			if (dependents == m_dependents.end())
+				continue;
+
+			auto& list = dependents->second;
+			list.erase(std::remove(list.begin(), list.end(), waiting), list.end());
+			if (list.empty())
+				m_dependents.erase(dependents);
+		}
+
+		*task = std::move(*waiting);
+		m_waitingTasks.erase(waiting);
+		return true;
+	}
+
+	return false;
+}
+
+bool ResourceManager::cancelTask(Task& task)
+{
+	// must be called without m_loadingTaskMutex, freeing the loader releases its own ResourcePtrs
+	if (task.m_data->m_refCount > 0)
+		return false;
+
+	{
+		// m_resourceMutex keeps anyone from finding it by its shared hash in the meantime
+		std::lock_guard<std::recursive_mutex> l1(m_resourceMutex);
+		if (task.m_data->m_refCount > 0)
+			return false;
+
+		// reloads still go through, it might be cached and requested again
+		std::lock_guard<std::recursive_mutex> l2(task.m_data->m_mutex);
+		if (task.m_data->m_resource)
+			return false;
+
+		task.m_data->m_state = ResourceData::State::CANCELLED;
+		queueFree(task.m_data);
+	}
+
+	recordLoad(task, LoadTelemetry::Outcome::Cancelled);
+	task.m_loader = nullptr; // its dependencies might get cancelled too
+	return true;
+}
+
+void ResourceManager::recordLoad(const Task& task, LoadTelemetry::Outcome outcome)
+{
+	auto now = LoadTelemetry::Clock::now();
+	float totalMs = std::chrono::duration<float, std::milli>(now - task.m_requestedAt).count();
+
+	LoadTelemetry::Load load;
+	load.m_name = task.m_data->m_debugName;
+	load.m_type = task.m_loader->getTypeName().str();
+	load.m_outcome = outcome;
+	load.m_reload = task.m_reload;
+	load.m_queuedMs = std::max(totalMs - task.m_loadMs, 0.0f);
+	load.m_loadMs = task.m_loadMs;
+	load.m_requeues = task.m_requeues;
+	load.m_bytesRead = task.m_loader->m_bytesRead;
+	load.m_requestedMs = m_telemetry.toMs(task.m_requestedAt);
+	load.m_finishedMs = m_telemetry.toMs(now);
+	m_telemetry.record(task.m_data, std::move(load), task.m_loader->m_dependencies);
+}
+
+void ResourceManager::resolveDependents(ResourceData* data)
+{
+	// m_loadingTaskMutex must be locked
+	auto dependents = m_dependents.find(data);
+	if (dependents == m_dependents.end())
+		return;
+
+	for (auto it : dependents->second)
+	{
+		if (--it->m_pendingDependencies <= 0)
+		{
+			m_loadingTasks[(std::size_t)it->m_data->m_priority].push_back(std::move(*it));
+			m_waitingTasks.erase(it);
+		}
+	}
+	m_dependents.erase(dependents);
+}
+
+bool ResourceManager::popTask(Task* task)
+{
+	// m_loadingTaskMutex must be locked
+	for (auto& tasks : m_loadingTasks)
+	{
+		if (!tasks.empty())
+		{
+			*task = std::move(tasks.front());
+			tasks.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ResourceManager::wakeDeferredTasks()
+{
+	// m_loadingTaskMutex must be locked
+	for (Task& task : m_deferredTasks)
+		m_loadingTasks[(std::size_t)task.m_data->m_priority].push_back(std::move(task));
+
+	m_deferredTasks.clear();
+}
+
+ResourceManager::PriorityScope::PriorityScope(LoadPriority priority):
+m_previous(s_defaultPriority)
 {
-	return !m_loadingTasks.empty();
+	s_defaultPriority = priority;
+}
+
+ResourceManager::PriorityScope::~PriorityScope()
+{
+	s_defaultPriority = m_previous;
 }
 
 void ResourceManager::startReloading()
@@ -144,10 +431,17 @@ void ResourceManager::startReloading()
 	m_needsReload = false;
 
 	std::vector<ResourceData*> reloadingResources;
-	for (auto it = m_resources.begin(); it != m_resources.end(); ++it)
 	{
-		if (it->m_reloader && it->m_reloader->m_reload > 0)
-			reloadingResources.push_back(&(*it));
+		std::lock_guard<std::recursive_mutex> l(m_resourceMutex);
+		m_resources.forEach([&](ResourceData& data) {
+			if (data.m_reloader && data.m_reloader->m_reload > 0)
+			{
+				// out of the cache while the loader has it, it goes back in once the reload's notification is processed
+				if (data.m_cold)
+					makeWarm(&data);
+				reloadingResources.push_back(&data);
+			}
+		});
 	}
 
 	if (reloadingResources.empty())
@@ -157,14 +451,10 @@ void ResourceManager::startReloading()
 	{
 		ResourceData* data = *it;
 		std::shared_ptr<Resource::Loader> loader(data->m_reloader->createLoader());
-
-		{
-			std::lock_guard<std::mutex> l(m_loadingTaskMutex);
-			m_loadingTasks.push(Task{ loader, data });
-		}
+		pushTask(Task{ loader, data, 0 });
 	}
 
-	if (m_autoStartTasks && m_loadingTasks.size() > 0 && m_tasksInProgress <= 0)
+	if (m_autoStartTasks)
 	{
 		startLoading();
 	}
@@ -175,6 +465,20 @@ void ResourceManager::setAutoStartTasks(bool b)
 	m_autoStartTasks = b;
 }
 
+void ResourceManager::registerPrefetchBatch(StringView typeName, WarmList::BatchPrefetcher&& prefetcher)
+{
+	m_warmList.registerBatch(typeName, std::move(prefetcher));
+}
+
+void ResourceManager::useWarmList(StringView path, float recordSeconds)
+{
+	PriorityScope scope(LoadPriority::Prefetch);
+	m_warmList.load(path, recordSeconds);
+
+	if (m_autoStartTasks)
+		startLoading();
+}
+
 void ResourceManager::setFreeResources(bool b)
 {
 	m_freeResources = b;
@@ -186,53 +490,294 @@ void ResourceManager::setFreeResources(bool b)
 
 void ResourceManager::clearNotificationsFor(const Resource* resource)
 {
+	std::lock_guard<std::recursive_mutex> l(m_resourceMutex);
 	auto it = std::remove_if(m_notificationQueue.begin(), m_notificationQueue.end(), [=](const ResourceStateChanged& rsc) { return rsc.m_resourceData->m_resource == resource; });
+	for (auto removed = it; removed != m_notificationQueue.end(); ++removed)
+	{
+		if (--removed->m_resourceData->m_pendingNotifications == 0 && removed->m_resourceData->m_refCount <= 0)
+			queueFree(removed->m_resourceData);
+	}
 	m_notificationQueue.erase(it, m_notificationQueue.end());
 }
 
-void ResourceManager::freeUnreferenced(bool freeSingleton)
+ResourceData& ResourceManager::newResourceData()
+{
+	// m_resourceMutex must be locked
+	return m_resources.allocate();
+}
+
+void ResourceManager::addShared(ResourceData* data)
+{
+	// m_resourceMutex must be locked
+	if (data->m_sharedHash != 0)
+		m_shared.emplace(data->m_sharedHash, data->m_handle);
+}
+
+ResourceData* ResourceManager::findShared(std::size_t sharedHash)
+{
+	// m_resourceMutex must be locked
+	auto range = m_shared.equal_range(sharedHash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		ResourceData* data = m_resources.resolve(it->second);
+		if (!data)
+			continue;
+
+		std::lock_guard<std::recursive_mutex> l(data->m_mutex);
+		if (data->m_state != ResourceData::State::CANCELLED)
+			return data;
+	}
+	return nullptr;
+}
+
+void ResourceManager::queueFree(ResourceData* data)
 {
 	std::lock_guard<std::recursive_mutex> l(m_resourceMutex);
+	if (data->m_freeQueued)
+		return;
 
-	if (m_resources.empty()) return;
+	data->m_freeQueued = true;
+	m_freeCandidates.push_back(data->m_handle);
+}
+
+void ResourceManager::collect(float budgetMs)
+{
+	collectCandidates(budgetMs, false, true);
+}
+
+void ResourceManager::collectCandidates(float budgetMs, bool freeSingleton, bool incremental)
+{
+	using namespace std::chrono;
+	auto start = high_resolution_clock::now();
+	auto budget = duration<float, std::milli>(budgetMs);
+
+	std::vector<Resource*> asyncFrees;
+	bool freedAny = false;
+
+	std::lock_guard<std::recursive_mutex> l(m_resourceMutex);
+	if (m_collecting)
+		return; // released by a destructor below, the outer loop picks it up
 
-	void* front = &m_resources.front();
-	std::forward_list<ResourceData>::iterator it = m_resources.begin();
-	std::forward_list<ResourceData>::iterator itBefore = m_resources.before_begin();
-	for (; it != m_resources.end(); ++it, ++itBefore)
+	m_collecting = true;
+	while (!m_freeCandidates.empty())
 	{
-		if (it->m_refCount <= 0 && (freeSingleton || it->m_singleton == false))
+		// a budget of 0 frees everything, otherwise always free at least one so a tiny budget still makes progress
+		if (budgetMs > 0.0f && freedAny && high_resolution_clock::now() - start > budget)
+			break;
+
+		ResourceData* data = m_resources.resolve(m_freeCandidates.front());
+		m_freeCandidates.pop_front();
+		if (!data)
+			continue; // evicted from the cache while it was queued
+
+		data->m_freeQueued = false;
+
+		// picked up again, or still has a pending notification (requeued when it's processed)
+		if (data->m_refCount > 0 || (data->m_singleton && !freeSingleton) || data->m_pendingNotifications > 0)
+			continue;
+
+		// a loader is still using it, requeued with its notification
+		if (data->m_state == ResourceData::State::WAITING || data->m_state == ResourceData::State::LOADING)
+			continue;
+
+		if (incremental)
 		{
-			// don't delete if there's a pending notification for it
-			if (std::find_if(m_notificationQueue.begin(), m_notificationQueue.end(), [=](const ResourceStateChanged& c) { return c.m_resourceData == &(*it); }) == m_notificationQueue.end())
-			{
-				// if you crash here, you might have a circular dependence in your ResourcePtr's
-				m_resources.erase_after(itBefore);
+			if (data->m_cold)
+				continue;
 
-				// the deconstructor of the thing we erased might erase more stuff, start loop back at the beginning
-				freeUnreferenced(freeSingleton);
-				return;
+			// keep it around in case it's requested again, it has to be findable by its shared hash
+			if (data->m_memory && data->m_memory->hasBudget() && data->m_sharedHash != 0 && data->m_resource)
+			{
+				makeCold(data);
+				trimMemory(*data->m_memory, &asyncFrees);
+				continue;
 			}
 		}
+
+		freeResourceData(data, incremental ? &asyncFrees : nullptr);
+		freedAny = true;
+	}
+
+	// budgets might've been lowered or live resources grown
+	if (incremental)
+	{
+		for (auto& memory : m_memory)
+			trimMemory(memory.second, &asyncFrees);
+	}
+	m_collecting = false;
+
+	if (!asyncFrees.empty())
+	{
+		m_threadPool->enqueue([](const std::vector<Resource*>& resources) {
+			for (Resource* resource : resources)
+				delete resource;
+		}, std::move(asyncFrees));
 	}
 }
 
-void ResourceManager::release(ResourceData* data)
+void ResourceManager::freeResourceData(ResourceData* data, std::vector<Resource*>* asyncFrees)
 {
-	int refCount;
+	// m_resourceMutex must be locked
+	if (ResourceMemory* memory = data->m_memory)
 	{
-		std::lock_guard<std::recursive_mutex> l(data->m_mutex);
-		refCount = --data->m_refCount;
+		memory->m_cpu -= data->m_cpuSize;
+		memory->m_gpu -= data->m_gpuSize;
+		memory->m_count--;
+		if (data->m_cold)
+		{
+			memory->m_coldCpu -= data->m_cpuSize;
+			memory->m_coldGpu -= data->m_gpuSize;
+			memory->m_cold.erase(data->m_coldNode);
+		}
 	}
 
-	if (refCount <= 0 && m_freeResources && !data->m_singleton)
+	if (asyncFrees && data->m_owns && data->m_resource && data->m_resource->canFreeAsync() && !m_threadPool.released())
 	{
-		freeUnreferenced();
+		asyncFrees->push_back(data->m_resource);
+		data->m_resource = nullptr;
+	}
+
+	m_telemetry.forget(data);
+
+	auto range = m_shared.equal_range(data->m_sharedHash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second == data->m_handle)
+		{
+			m_shared.erase(it);
+			break;
+		}
+	}
+
+	// if you crash here, you might have a circular dependence in your ResourcePtr's
+	// the destructor might release more resources, they're appended to m_freeCandidates
+	m_resources.free(data);
+}
+
+void ResourceManager::setMemoryBudget(StringView type, std::size_t cpuBytes, std::size_t gpuBytes)
+{
+	std::lock_guard<std::recursive_mutex> l(m_resourceMutex);
+	ResourceMemory& memory = m_memory[type.str()];
+	memory.m_cpuBudget = cpuBytes;
+	memory.m_gpuBudget = gpuBytes;
+}
+
+void ResourceManager::updateMemory(ResourceData* data)
+{
+	// m_resourceMutex must be locked
+	ResourceMemory* memory = data->m_memory;
+	if (!memory)
+		return;
+
+	std::size_t cpu = data->m_resource ? data->m_resource->getCpuSize() : 0;
+	std::size_t gpu = data->m_resource ? data->m_resource->getGpuSize() : 0;
+	memory->m_cpu += cpu - data->m_cpuSize;
+	memory->m_gpu += gpu - data->m_gpuSize;
+	if (data->m_cold)
+	{
+		memory->m_coldCpu += cpu - data->m_cpuSize;
+		memory->m_coldGpu += gpu - data->m_gpuSize;
 	}
+
+	data->m_cpuSize = cpu;
+	data->m_gpuSize = gpu;
+}
+
+void ResourceManager::makeCold(ResourceData* data)
+{
+	// m_resourceMutex must be locked
+	updateMemory(data); // sizes might've changed since it loaded
+
+	ResourceMemory* memory = data->m_memory;
+	data->m_cold = true;
+	data->m_coldNode = memory->m_cold.insert(memory->m_cold.end(), data);
+	memory->m_coldCpu += data->m_cpuSize;
+	memory->m_coldGpu += data->m_gpuSize;
+}
+
+void ResourceManager::makeWarm(ResourceData* data)
+{
+	// m_resourceMutex must be locked
+	ResourceMemory* memory = data->m_memory;
+	data->m_cold = false;
+	memory->m_cold.erase(data->m_coldNode);
+	memory->m_coldCpu -= data->m_cpuSize;
+	memory->m_coldGpu -= data->m_gpuSize;
+}
+
+void ResourceManager::trimMemory(ResourceMemory& memory, std::vector<Resource*>* asyncFrees)
+{
+	// m_resourceMutex must be locked. Skips the same entries collectCandidates() does, a loader or a notification still has them
+	auto it = memory.m_cold.begin();
+	while (memory.overBudget() && it != memory.m_cold.end())
+	{
+		ResourceData* data = *it++;
+		if (data->m_state == ResourceData::State::WAITING || data->m_state == ResourceData::State::LOADING || data->m_pendingNotifications > 0)
+			continue;
+
+		freeResourceData(data, asyncFrees);
+	}
+}
+
+void ResourceManager::freeUnreferenced(bool freeSingleton)
+{
+	std::lock_guard<std::recursive_mutex> l(m_resourceMutex);
+
+	// released singletons aren't queued, keep sweeping while freeing them releases others
+	std::size_t count;
+	do
+	{
+		count = m_resources.size();
+		m_resources.forEach([&](ResourceData& data) {
+			if (data.m_refCount <= 0 && (freeSingleton || data.m_singleton == false))
+				queueFree(&data);
+		});
+
+		collectCandidates(0.0f, freeSingleton, false);
+	} while (m_resources.size() != count);
+}
+
+void ResourceManager::release(ResourceData* data)
+{
+	// lock free unless it was the last reference, singletons are only freed on shutdown (see freeUnreferenced(true))
+	bool singleton = data->m_singleton;
+	ResourceHandle handle = data->m_handle; // while our reference still keeps the slot alive
+	int refCount = data->m_refCount.fetch_sub(1, std::memory_order_acq_rel) - 1;
+	if (refCount > 0 || singleton)
+		return;
+
+	// from here on a shared hash lookup can pick it up again and another release() or collect() can free the slot,
+	// only touch it through the handle under m_resourceMutex
+	ResourceData::State state;
+	{
+		std::lock_guard<std::recursive_mutex> l(m_resourceMutex);
+		data = m_resources.resolve(handle);
+		if (!data || data->m_refCount > 0)
+			return;
+
+		std::lock_guard<std::recursive_mutex> l2(data->m_mutex);
+		state = data->m_state;
+		queueFree(data); // collectCandidates() leaves it alone while it's WAITING or LOADING
+	}
+
+	// drop its load if it hasn't started, in flight loads are cancelled by the loader thread.
+	// cancelTask() checks the count again under m_resourceMutex
+	Task task;
+	if (state == ResourceData::State::WAITING && takeQueuedTask(handle, &task) && !cancelTask(task))
+		pushTask(std::move(task)); // requested again in the meantime
+
+	// incremental like the per frame collect(), so the cold cache and async frees apply
+	if (m_freeResources)
+		collect(s_releaseCollectMs);
 }
 
 void ResourceManager::update()
 {
+	if (!m_telemetry.isStartupDone() && !isLoading())
+		m_telemetry.endStartup();
+
+	m_warmList.update();
+
 	std::lock_guard<std::recursive_mutex> l(m_resourceMutex);
 	for (const ResourceStateChanged& e : m_notificationQueue)
 	{
@@ -252,6 +797,17 @@ void ResourceManager::update()
 			data->m_resource = data->m_reloadedResource;
 			data->m_reloadedResource = nullptr;
 		}
+
+		if (!data->m_memory && e.m_loader)
+		{
+			data->m_memory = &m_memory[e.m_loader->getTypeName().str()];
+			data->m_memory->m_count++;
+		}
+		updateMemory(data);
+
+		// released while it was loading
+		if (--data->m_pendingNotifications == 0 && data->m_refCount <= 0)
+			queueFree(data);
 	}
 	m_notificationQueue.clear();
 }
@@ -267,6 +823,31 @@ void ResourceManager::imgui()
 	if (Begin("ResourceManager", opened))
 	{
 		Text("Loading Tasks: %d", m_tasksInProgress.load());
+		{
+			std::lock_guard<std::recursive_mutex> l(m_resourceMutex);
+			Text("Resources: %d in %d slots", (int)m_resources.size(), (int)m_resources.capacity());
+			StringId::Stats strings = StringId::getStats();
+			Text("Interned strings: %d (%s)", (int)strings.m_count, prettySize(strings.m_bytes).c_str());
+			Text("Waiting to be freed: %d", (int)m_freeCandidates.size());
+
+			auto budget = [](std::size_t size) { return size > 0 ? prettySize(size) : std::string("-"); };
+			for (const auto& memory : m_memory)
+			{
+				const ResourceMemory& m = memory.second;
+				Text("%s: %d loaded (%d cached), cpu %s / %s (%s cached), gpu %s / %s (%s cached)", memory.first.c_str(), m.m_count, (int)m.m_cold.size(),
+					prettySize(m.m_cpu).c_str(), budget(m.m_cpuBudget).c_str(), prettySize(m.m_coldCpu).c_str(),
+					prettySize(m.m_gpu).c_str(), budget(m.m_gpuBudget).c_str(), prettySize(m.m_coldGpu).c_str());
+			}
+		}
+		{
+			std::lock_guard<std::mutex> l(m_loadingTaskMutex);
+			Text("Queued: %d blocking, %d on screen, %d normal, %d prefetch (%d deferred, %d waiting on dependencies)",
+				(int)m_loadingTasks[(std::size_t)LoadPriority::Blocking].size(), (int)m_loadingTasks[(std::size_t)LoadPriority::OnScreen].size(),
+				(int)m_loadingTasks[(std::size_t)LoadPriority::Normal].size(), (int)m_loadingTasks[(std::size_t)LoadPriority::Prefetch].size(),
+				(int)m_deferredTasks.size(), (int)m_waitingTasks.size());
+		}
+
+		m_telemetry.imgui();
 
 		Columns(3);
 
@@ -286,8 +867,9 @@ void ResourceManager::imgui()
 		std::vector<Display> display;
 		{
 			std::lock_guard<std::recursive_mutex> l(m_resourceMutex);
-			for (const ResourceData& data : m_resources)
+			m_resources.forEach([&](const ResourceData& data) {
 				display.push_back({ data.m_refCount, data.m_debugName.c_str(), data.m_state });
+			});
 		}
 
 		std::sort(display.begin(), display.end(), [](const Display& d1, const Display& d2) {return d1.m_refCount > d2.m_refCount; });
@@ -312,6 +894,8 @@ void ResourceManager::imgui()
 			if (data.m_state == State::WAITING) { Text("Waiting");  }
 			else if (data.m_state == State::LOADING) { Text("Loading"); }
 			else if (data.m_state == State::LOADED) { Text("Loaded"); }
+			else if (data.m_state == State::FAILED) { Text("Failed"); }
+			else if (data.m_state == State::CANCELLED) { Text("Cancelled"); }
 			ImGui::NextColumn();
 
 			PopID();
@@ -327,6 +911,74 @@ void ResourceManager::setReloadDirty()
 	m_needsReload = true;
 }
 
+ResourceTable::~ResourceTable()
+{
+	clear();
+}
+
+ResourceData& ResourceTable::allocate()
+{
+	std::uint32_t index;
+	if (!m_freeSlots.empty())
+	{
+		index = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	else
+	{
+		index = m_slotCount++;
+		if (index / ChunkSize >= m_chunks.size())
+			m_chunks.emplace_back(new Slot[ChunkSize]);
+	}
+
+	Slot& slot = getSlot(index);
+	ResourceData* data = new(&slot.m_storage) ResourceData();
+	data->m_handle = { index, slot.m_generation };
+	slot.m_used = true;
+	m_size++;
+	return *data;
+}
+
+void ResourceTable::free(ResourceData* data)
+{
+	std::uint32_t index = data->m_handle.m_index;
+	Slot& slot = getSlot(index);
+	CHECK_F(slot.m_used && slot.get() == data);
+
+	// unused before destructing, it can release (or create) other resources and shouldn't be found while it's half gone.
+	// The slot only goes back on the free list afterwards so nothing gets constructed on top of it
+	slot.m_used = false;
+	if (++slot.m_generation == 0)
+		slot.m_generation = 1;
+	m_size--;
+
+	data->~ResourceData();
+	m_freeSlots.push_back(index);
+}
+
+void ResourceTable::clear()
+{
+	for (std::uint32_t i = 0; i < m_slotCount; i++)
+	{
+		if (getSlot(i).m_used)
+			free(getSlot(i).get());
+	}
+}
+
+ResourceData* ResourceTable::resolve(ResourceHandle handle) const
+{
+	if (handle.m_generation == 0 || handle.m_index >= m_slotCount)
+		return nullptr;
+
+	Slot& slot = getSlot(handle.m_index);
+	return slot.m_used && slot.m_generation == handle.m_generation ? slot.get() : nullptr;
+}
+
+bool Resource::Loader::isCancelled() const
+{
+	return m_data && m_data->m_refCount <= 0;
+}
+
 Resource::Reloader::~Reloader()
 {
 }
@@ -2,8 +2,12 @@
 
 class ThreadPool;
 class EventManager;
+struct ResourceData;
+template<typename Resource> class ResourcePtr;
 #include "../Misc/StringView.h"
 #include "../Misc/CallStack.h"
+#include "LoadTelemetry.h"
+#include "WarmList.h"
 
 //#define JUNKPILE_RESOURCE_RECORD_STACK
 
@@ -26,12 +30,29 @@ protected:
 		virtual Reloader* createReloader() { return nullptr; }
 		virtual std::string getDebugName() const { return std::string("<") + (const char*)getTypeName() + ">"; }
 		virtual StringView getTypeName() const = 0;
+		virtual std::string getPrefetchKey() const { return {}; } // argument that requests this resource again, see ResourceManager::useWarmList
+
+	protected:
+		// load() won't be called until every dependency is loaded or failed.
+		// The loader must keep the ResourcePtr alive, can be called from load() too
+		template<typename T> void dependsOn(const ResourcePtr<T>&);
+
+		// every reference to the resource was released, return nullptr before doing any expensive work
+		bool isCancelled() const;
+
+		void addBytesRead(std::size_t bytes) { m_bytesRead += bytes; } // for the load telemetry
 
 	protected:
 #ifdef JUNKPILE_RESOURCE_RECORD_STACK 
 		Loader() { m_stack = CallStack().str(); }
 		std::string m_stack;
 #endif
+
+	private:
+		std::vector<ResourceData*> m_dependencies;
+		const ResourceData* m_data{ nullptr };
+		std::size_t m_bytesRead{ 0 };
+		friend class ResourceManager;
 	};
 	friend class ResourceManager;
 	friend struct ResourceStateChanged;
@@ -84,9 +105,17 @@ protected:
 public:
 	virtual ~Resource() {}
 
+	// the destructor doesn't touch main thread state (gpu objects, scripts), so the garbage collector can run it on the thread pool
+	virtual bool canFreeAsync() const { return false; }
+
+	// bytes held by this resource, counted against ResourceManager::setMemoryBudget
+	virtual std::size_t getCpuSize() const { return 0; }
+	virtual std::size_t getGpuSize() const { return 0; }
+
 	friend struct ResourceData;
 };
 
+struct ResourceData;
 template<typename T>
 class SingletonResource : public Resource
 {
@@ -97,13 +126,50 @@ public:
 
 protected:
 	static std::mutex s_mutex;
+	static std::atomic<ResourceData*> s_data; // cached so ResourcePtr<T> doesn't have to search for the singleton
+
+	friend class ResourceManager;
+};
+
+// order the loaders pick up queued resources
+enum class LoadPriority
+{
+	Blocking, // someone is waiting on it
+	OnScreen,
+	Normal,
+	Prefetch,
+	Count
+};
+
+// memory used by one resource type (Loader::getTypeName)
+struct ResourceMemory
+{
+	std::size_t m_cpuBudget{ 0 }, m_gpuBudget{ 0 }; // 0 = unreferenced resources are freed right away
+	std::size_t m_cpu{ 0 }, m_gpu{ 0 }; // everything resident, cold resources included
+	std::size_t m_coldCpu{ 0 }, m_coldGpu{ 0 };
+	int m_count{ 0 };
+	std::list<ResourceData*> m_cold; // unreferenced but cached, least recently released first
+
+	bool hasBudget() const { return m_cpuBudget > 0 || m_gpuBudget > 0; }
+	bool overBudget() const { return (m_cpuBudget > 0 && m_cpu > m_cpuBudget) || (m_gpuBudget > 0 && m_gpu > m_gpuBudget); }
+};
+
+// index into ResourceManager's slot table, the generation goes stale once the slot is freed and reused
+struct ResourceHandle
+{
+	std::uint32_t m_index{ 0 };
+	std::uint32_t m_generation{ 0 }; // 0 = null handle
+
+	bool operator==(const ResourceHandle& h) const { return m_index == h.m_index && m_generation == h.m_generation; }
+	bool operator!=(const ResourceHandle& h) const { return !(*this == h); }
 };
 
 struct ResourceData
 {
 	std::string m_debugName{};
-	int m_refCount{ 1 };
+	std::atomic<int> m_refCount{ 1 }; // ResourcePtr copies and releases only touch this
 	bool m_singleton{ false };
+	std::atomic<ResourceData*>* m_singletonSlot{ nullptr }; // cleared when the singleton is freed
 
 	bool m_owns{ true };
 	Resource* m_resource{ nullptr };
@@ -114,13 +180,24 @@ struct ResourceData
 		LOADING,
 		LOADED,
 		FAILED,
+		CANCELLED, // released before it finished loading
 		UNMANAGED // not managed by the resource manager
 	};
 	State m_state{ State::WAITING };
+	LoadPriority m_priority{ LoadPriority::Normal };
 	std::size_t m_sharedHash{ 0 };
 	std::tuple<int, std::string> m_error{ 0, {} };
 
 	Resource::Reloader* m_reloader;
+
+	ResourceHandle m_handle; // slot in ResourceManager::m_resources, null for unmanaged resources
+	bool m_freeQueued{ false }; // in ResourceManager::m_freeCandidates
+	int m_pendingNotifications{ 0 };
+
+	ResourceMemory* m_memory{ nullptr }; // set once loaded, null for singletons and added resources
+	std::size_t m_cpuSize{ 0 }, m_gpuSize{ 0 };
+	bool m_cold{ false }; // unreferenced but kept until its type goes over budget
+	std::list<ResourceData*>::iterator m_coldNode;
 	
 	std::recursive_mutex m_mutex; // recursive cuz loading a resource might try to get a singleton which locks the resource while searching for it
 
@@ -133,7 +210,55 @@ struct ResourceData
 		}
 	}
 
-	~ResourceData() { deleteResource(); delete m_reloader; }
+	~ResourceData()
+	{
+		if (m_singletonSlot)
+			m_singletonSlot->store(nullptr);
+
+		deleteResource();
+		delete m_reloader;
+	}
+};
+
+// ResourceData lives in fixed size chunks so pointers stay valid while the table grows,
+// freed slots are reused right away with a new generation
+class ResourceTable
+{
+public:
+	ResourceTable() = default;
+	ResourceTable(const ResourceTable&) = delete;
+	~ResourceTable();
+
+	ResourceData& allocate();
+	void free(ResourceData*);
+	void clear();
+
+	ResourceData* resolve(ResourceHandle) const; // nullptr if the handle is stale
+	template<typename Pred> ResourceData* find(Pred);
+	template<typename F> void forEach(F);
+
+	std::size_t size() const { return m_size; }
+	std::size_t capacity() const { return m_chunks.size() * ChunkSize; }
+
+protected:
+	static const std::uint32_t ChunkSize = 256;
+
+	struct Slot
+	{
+		std::aligned_storage<sizeof(ResourceData), alignof(ResourceData)>::type m_storage;
+		std::uint32_t m_generation{ 1 };
+		bool m_used{ false };
+
+		ResourceData* get() { return reinterpret_cast<ResourceData*>(&m_storage); }
+	};
+
+	Slot& getSlot(std::uint32_t index) const { return m_chunks[index / ChunkSize][index % ChunkSize]; }
+
+protected:
+	std::vector<std::unique_ptr<Slot[]>> m_chunks;
+	std::vector<std::uint32_t> m_freeSlots;
+	std::uint32_t m_slotCount{ 0 }; // slots handed out at least once
+	std::size_t m_size{ 0 };
 };
 
 struct NewPtr_t {};
@@ -169,6 +294,8 @@ public:
 	void release();
 	bool released() const;
 
+	void setPriority(LoadPriority);
+
 	Resource* get() const;
 
 	State getState() const;
@@ -183,6 +310,10 @@ public:
 	bool operator==(const ResourcePtr<Resource>&) const;
 
 	static ResourcePtr<Resource> fromResourceData(ResourceData*);
+	ResourceData* getResourceData() const;
+
+protected:
+	Resource* getResource() const;
 
 protected:
 	ResourceData* m_data;
@@ -205,14 +336,37 @@ public:
 	void startLoading();
 	bool isLoading() const;
 
+	void setPriority(ResourceData*, LoadPriority);
+
+	// resources requested on this thread while the scope is alive are queued with this priority
+	class PriorityScope
+	{
+	public:
+		PriorityScope(LoadPriority);
+		~PriorityScope();
+
+	protected:
+		LoadPriority m_previous;
+	};
+
 	void startReloading();
 
 	void setAutoStartTasks(bool);
 
+	// resources of this type are recreated from a warm list as ResourcePtr<Resource>(NewPtr, key), typeName is the loader's getTypeName()
+	template<typename Resource> void registerPrefetchType(StringView typeName);
+	void registerPrefetchBatch(StringView typeName, WarmList::BatchPrefetcher&&); // called with all of the type's keys first
+	// prefetches the shared resources the last session requested in its first seconds, and records this session's list to the same path
+	void useWarmList(StringView path, float recordSeconds = 10.0f);
+
 	void update();
 	
 	void setFreeResources(bool);
-	void freeUnreferenced(bool freeSingleton = false);
+	void freeUnreferenced(bool freeSingleton = false); // full sweep, prefer collect()
+	void collect(float budgetMs); // frees released resources until the budget runs out (0 = no limit), call once a frame
+
+	// unreferenced resources of this type stay cached until it uses more than this, least recently released are evicted first
+	void setMemoryBudget(StringView type, std::size_t cpuBytes, std::size_t gpuBytes);
 
 	template<typename Resource> ResourcePtr<Resource> addSingletonResource(Resource*, const char* debugName, bool owns);
 	template<typename Resource> ResourcePtr<Resource> addLoadedResource(Resource*, const char* debugName, std::size_t hash = 0);
@@ -227,27 +381,70 @@ protected:
 	{
 		std::shared_ptr<Resource::Loader> m_loader;
 		ResourceData* m_data;
+		int m_pendingDependencies;
+
+		LoadTelemetry::Clock::time_point m_requestedAt{ LoadTelemetry::Clock::now() };
+		float m_loadMs{ 0.0f };
+		int m_requeues{ 0 };
+		bool m_reload{ false };
 	};
 
-	template<typename Resource>
-	ResourceData* addRefSpecialized(std::true_type, std::size_t);
+	template<typename Resource, typename... Args>
+	ResourceData* addRefSpecialized(std::true_type, Args&&...);
 
 	template<typename Resource, typename... Args>
-	ResourceData* addRefSpecialized(std::false_type, std::size_t sharedHash, Args&&...);
+	ResourceData* addRefSpecialized(std::false_type, Args&&...);
+
+	ResourceData& newResourceData();
+	void addShared(ResourceData*);
+	ResourceData* findShared(std::size_t sharedHash);
+	void queueFree(ResourceData*);
+	void collectCandidates(float budgetMs, bool freeSingleton, bool incremental);
+	void freeResourceData(ResourceData*, std::vector<Resource*>* asyncFrees);
+
+	void updateMemory(ResourceData*);
+	void makeCold(ResourceData*);
+	void makeWarm(ResourceData*);
+	void trimMemory(ResourceMemory&, std::vector<Resource*>* asyncFrees);
 
 	void setReloadDirty();
 	void clearNotificationsFor(const Resource* resource);
 
+	void pushTask(Task&&);
+	bool popTask(Task*);
+	bool waitOnDependencies(Task&);
+	bool takeQueuedTask(ResourceHandle, Task*);
+	bool cancelTask(Task&);
+	void recordLoad(const Task&, LoadTelemetry::Outcome);
+	void resolveDependents(ResourceData*);
+	void wakeDeferredTasks();
+	void loaderLoop();
+
 protected:
-	std::forward_list<ResourceData> m_resources;
+	ResourceTable m_resources;
+	std::unordered_multimap<std::size_t, ResourceHandle> m_shared; // by shared hash, so lookups don't scan the table
 	std::recursive_mutex m_resourceMutex;
-
-	std::queue<Task> m_loadingTasks;
-	std::mutex m_loadingTaskMutex;
+	std::deque<ResourceHandle> m_freeCandidates; // refcount hit zero, checked again when collected (might've been evicted since)
+	bool m_collecting{ false };
+	std::map<std::string, ResourceMemory> m_memory;
+
+	LoadTelemetry m_telemetry;
+	WarmList m_warmList;
+
+	std::array<std::deque<Task>, (std::size_t)LoadPriority::Count> m_loadingTasks;
+	std::vector<Task> m_deferredTasks; // loaders that weren't ready, requeued when another resource finishes
+	std::list<Task> m_waitingTasks; // loaders with dependencies that haven't finished
+	std::unordered_map<ResourceData*, std::vector<std::list<Task>::iterator>> m_dependents;
+	mutable std::mutex m_loadingTaskMutex;
+	std::condition_variable m_loadingCondition;
+	bool m_stopLoading{ false };
 	std::vector<ResourceStateChanged> m_notificationQueue;
 
 	ResourcePtr<ThreadPool> m_threadPool;
 	std::atomic<unsigned int> m_tasksInProgress;
+	std::atomic<unsigned int> m_loadersRunning;
+
+	static thread_local LoadPriority s_defaultPriority;
 
 	bool m_autoStartTasks;
 
@@ -268,46 +465,75 @@ extern ResourceManager* g_resourceManager;
 template<typename Resource, typename... Args>
 ResourceData* ResourceManager::addRef(Args&&... args)
 {
-	std::tuple<bool, std::size_t> shared = typename Resource::getSharedHash(std::forward<Args>(args)...);
-	if (std::get<bool>(shared) == true)
+	return addRefSpecialized<Resource>(std::is_base_of<SingletonResource<Resource>, Resource>{}, std::forward<Args>(args)...);
+}
+
+template<typename Resource, typename... Args>
+ResourceData* ResourceManager::addRefSpecialized(std::true_type, Args&&...)
+{
+	// hot path, singletons are requested every frame
+	ResourceData* data = SingletonResource<Resource>::s_data.load(std::memory_order_acquire);
+	if (data)
 	{
-		std::lock_guard<std::recursive_mutex> l(m_resourceMutex);
-		for (ResourceData& data : m_resources)
-		{
-			std::lock_guard<std::recursive_mutex> l(data.m_mutex);
-			if (data.m_sharedHash == std::get<std::size_t>(shared))
-			{
-				data.m_refCount++;
-				return &data;
-			}
-		}
+		data->m_refCount++;
+		return data;
 	}
 
-	return addRefSpecialized<Resource>(std::is_base_of<SingletonResource<Resource>, Resource>{}, std::get<std::size_t>(shared), std::forward<Args>(args)...);
-}
+	Resource* singleton = (Resource*)Resource::getSingleton(); // don't hold m_resourceMutex, the constructor can wait on other resources
 
-template<typename Resource>
-ResourceData* ResourceManager::addRefSpecialized(std::true_type, std::size_t)
-{
-	Resource* singleton = (Resource*)Resource::getSingleton();
-	auto it = std::find_if(m_resources.begin(), m_resources.end(), [=](const ResourceData& d) { return d.m_resource == singleton; });
-	if (it != m_resources.end())
-		return &(*it);
+	std::lock_guard<std::recursive_mutex> l(m_resourceMutex);
+	data = SingletonResource<Resource>::s_data.load(std::memory_order_acquire);
+	if (data)
+	{
+		data->m_refCount++;
+		return data;
+	}
 
 	ResourcePtr<Resource> ptr = addSingletonResource(singleton, typeid(Resource).name(), true);
-	ResourceData* data = &m_resources.front();
+	data = ptr.getResourceData();
 	data->m_refCount++; // don't free when ptr destructs
+	data->m_singletonSlot = &SingletonResource<Resource>::s_data;
+	SingletonResource<Resource>::s_data.store(data, std::memory_order_release);
 	return data;
 }
 
 template<typename Resource, typename... Args>
-ResourceData* ResourceManager::addRefSpecialized(std::false_type, std::size_t sharedHash, Args&&... args)
+ResourceData* ResourceManager::addRefSpecialized(std::false_type, Args&&... args)
 {
+	std::tuple<bool, std::size_t> shared = typename Resource::getSharedHash(std::forward<Args>(args)...);
+	std::size_t sharedHash = std::get<std::size_t>(shared);
+	if (std::get<bool>(shared) == true)
+	{
+		std::lock_guard<std::recursive_mutex> l(m_resourceMutex);
+		ResourceData* data = findShared(sharedHash);
+		if (data)
+		{
+			if (data->m_cold)
+				makeWarm(data);
+
+			if (m_warmList.isRecording())
+				m_warmList.hit(data);
+
+			// queued by a prefetch and now asked for, it shouldn't wait behind every Normal load
+			bool waiting;
+			{
+				std::lock_guard<std::recursive_mutex> l2(data->m_mutex);
+				waiting = data->m_state == ResourceData::State::WAITING;
+			}
+			if (waiting)
+				setPriority(data, std::min(data->m_priority, s_defaultPriority));
+
+			data->m_refCount++;
+			return data;
+		}
+	}
+
 	ResourceData* data = nullptr;
 	{
 		std::lock_guard<std::recursive_mutex> l(m_resourceMutex);
-		m_resources.emplace_front();
-		data = &m_resources.front();
+		data = &newResourceData();
+		data->m_sharedHash = sharedHash;
+		addShared(data);
 	}
 
 	std::shared_ptr<Resource::Loader> loader(typename Resource::createLoader(std::forward<Args>(args)...));
@@ -315,21 +541,36 @@ ResourceData* ResourceManager::addRefSpecialized(std::false_type, std::size_t sh
 	{
 		std::lock_guard<std::recursive_mutex> l(data->m_mutex);
 		data->m_debugName = loader->getDebugName();
-		data->m_sharedHash = sharedHash;
+		data->m_priority = s_defaultPriority;
 	}
 
+	// prefetches are speculative, only record what the session asked for
+	if (std::get<bool>(shared) && s_defaultPriority != LoadPriority::Prefetch && m_warmList.isRecording())
 	{
-		std::lock_guard<std::mutex> l(m_loadingTaskMutex);
-		m_loadingTasks.push(Task{ loader, data });
+		std::string key = loader->getPrefetchKey();
+		if (!key.empty())
+			m_warmList.record(loader->getTypeName(), key);
 	}
 
-	if (m_autoStartTasks && m_loadingTasks.size() == 1 && m_tasksInProgress <= 0)
+	pushTask(Task{ loader, data, 0 });
+
+	if (m_autoStartTasks)
 	{
 		startLoading();
 	}
 	return data;
 }
 
+template<typename Resource>
+void ResourceManager::registerPrefetchType(StringView typeName)
+{
+	m_warmList.registerType(typeName, [](const std::string& key, ResourceData** data) {
+		auto ptr = std::make_shared<ResourcePtr<Resource>>(NewPtr, StringView(key));
+		*data = ptr->getResourceData();
+		return std::static_pointer_cast<void>(ptr);
+	});
+}
+
 template<typename Resource>
 ResourcePtr<Resource> ResourceManager::addSingletonResource(Resource* resource, const char* debugName, bool owns)
 {
@@ -341,13 +582,12 @@ ResourcePtr<Resource> ResourceManager::addSingletonResource(Resource* resource,
 	LOG_IF_F(ERROR, b == false, "Singleton Resources(%s) must have a shared hash\n", typeid(Resource).name());
 
 	// TODO: only get hash for SAME types
-	auto it = std::find_if(m_resources.begin(), m_resources.end(), [=](const ResourceData& d) {return d.m_sharedHash == hash; });
-	LOG_IF_F(ERROR, it != m_resources.end(), "Multiple singleton resources (%s)", typeid(Resource).name());
+	LOG_IF_F(ERROR, m_shared.count(hash) != 0, "Multiple singleton resources (%s)", typeid(Resource).name());
 
-	m_resources.emplace_front();
-	ResourceData& data = m_resources.front();
+	ResourceData& data = newResourceData();
 	data.m_state = ResourceData::State::LOADED;
 	data.m_sharedHash = hash;
+	addShared(&data);
 	data.m_debugName = debugName;
 	data.m_owns = owns;
 	data.m_resource = resource;
@@ -360,10 +600,10 @@ ResourcePtr<Resource> ResourceManager::addLoadedResource(Resource* resource, con
 {
 	std::lock_guard<std::recursive_mutex> l(m_resourceMutex);
 
-	m_resources.emplace_front();
-	ResourceData& data = m_resources.front();
+	ResourceData& data = newResourceData();
 	data.m_state = ResourceData::State::LOADED;
 	data.m_sharedHash = hash;
+	addShared(&data);
 	data.m_debugName = debugName;
 	data.m_owns = true;
 	data.m_resource = resource;
@@ -406,10 +646,7 @@ ResourcePtr<Resource>::ResourcePtr(const ResourcePtr<Resource>& copy):
 m_data(copy.m_data)
 {
 	if (m_data)
-	{
-		std::lock_guard<std::recursive_mutex> l(m_data->m_mutex);
-		m_data->m_refCount++;
-	}
+		m_data->m_refCount.fetch_add(1, std::memory_order_relaxed);
 }
 
 template<typename Resource>
@@ -447,12 +684,13 @@ bool ResourcePtr<Resource>::ready(std::tuple<int, std::string>* error) const
 template<typename Resource>
 bool ResourcePtr<Resource>::waitReady(std::tuple<int, std::string>* error) const
 {
-	//TODO: prioritize resources that are being waited on
-
 	std::tuple<int, std::string> placeholder;
 	if (ready(&placeholder)) return true;
 	if(!error) error = &placeholder;
 
+	if (m_data->m_state != State::UNMANAGED)
+		g_resourceManager->setPriority(m_data, LoadPriority::Blocking);
+
 	using namespace std::chrono;
 	auto start = high_resolution_clock::now();
 	while (!ready(error) && std::get<int>(*error) == 0)
@@ -479,8 +717,7 @@ void ResourcePtr<Resource>::release()
 	{
 		if (m_data->m_state == State::UNMANAGED)
 		{
-			m_data->m_refCount--;
-			if (m_data->m_refCount <= 0)
+			if (m_data->m_refCount.fetch_sub(1, std::memory_order_acq_rel) <= 1)
 				delete m_data;
 		}
 		else
@@ -497,12 +734,16 @@ bool ResourcePtr<Resource>::released() const
 }
 
 template<typename Resource>
-Resource* ResourcePtr<Resource>::get() const
+void ResourcePtr<Resource>::setPriority(LoadPriority priority)
 {
-	waitReady(nullptr);
+	if (m_data && m_data->m_state != State::UNMANAGED)
+		g_resourceManager->setPriority(m_data, priority);
+}
 
-	std::lock_guard<std::recursive_mutex> l(m_data->m_mutex);
-	return (Resource*)m_data->m_resource;
+template<typename Resource>
+Resource* ResourcePtr<Resource>::get() const
+{
+	return getResource();
 }
 
 template<typename Resource>
@@ -521,41 +762,43 @@ bool ResourcePtr<Resource>::operator!() const
 template<typename Resource>
 Resource* ResourcePtr<Resource>::operator->() const
 {
-	waitReady(nullptr);
-
-	std::lock_guard<std::recursive_mutex> l(m_data->m_mutex);
-	return static_cast<Resource*>(m_data->m_resource);
+	return getResource();
 }
 
 template<typename Resource>
 Resource& ResourcePtr<Resource>::operator*() const
 {
-	waitReady(nullptr);
-
-	std::lock_guard<std::recursive_mutex> l(m_data->m_mutex);
-	return static_cast<Resource&>(*m_data->m_resource);
+	return *getResource();
 }
 
 template<typename Resource>
 ResourcePtr<Resource>::operator Resource*() const
 {
+	return getResource();
+}
+
+template<typename Resource>
+Resource* ResourcePtr<Resource>::getResource() const
+{
+	if (m_data->m_singleton)
+		return (Resource*)m_data->m_resource; // singletons are always loaded and never reloaded
+
 	waitReady(nullptr);
 
 	std::lock_guard<std::recursive_mutex> l(m_data->m_mutex);
-	return static_cast<Resource*>(m_data->m_resource);
+	return (Resource*)m_data->m_resource;
 }
 
 
 template<typename Resource>
 ResourcePtr<Resource>& ResourcePtr<Resource>::operator=(const ResourcePtr<Resource>& copy)
 {
+	// add first, releasing could free it when assigning to itself
+	if (copy.m_data)
+		copy.m_data->m_refCount.fetch_add(1, std::memory_order_relaxed);
+
 	release();
 	m_data = copy.m_data;
-	if(m_data)
-	{
-		std::lock_guard<std::recursive_mutex> l(m_data->m_mutex);
-		m_data->m_refCount++;
-	}
 	return *this;
 }
 
@@ -588,6 +831,43 @@ ResourcePtr<Resource> ResourcePtr<Resource>::fromResourceData(ResourceData* data
 	return result;
 }
 
+template<typename Resource>
+ResourceData* ResourcePtr<Resource>::getResourceData() const
+{
+	return m_data;
+}
+
+template<typename Pred>
+ResourceData* ResourceTable::find(Pred pred)
+{
+	for (std::uint32_t i = 0; i < m_slotCount; i++)
+	{
+		Slot& slot = getSlot(i);
+		if (slot.m_used && pred(*slot.get()))
+			return slot.get();
+	}
+	return nullptr;
+}
+
+template<typename F>
+void ResourceTable::forEach(F f)
+{
+	for (std::uint32_t i = 0; i < m_slotCount; i++)
+	{
+		Slot& slot = getSlot(i);
+		if (slot.m_used)
+			f(*slot.get());
+	}
+}
+
+template<typename T>
+void Resource::Loader::dependsOn(const ResourcePtr<T>& resource)
+{
+	ResourceData* data = resource.getResourceData();
+	if (data && std::find(m_dependencies.begin(), m_dependencies.end(), data) == m_dependencies.end())
+		m_dependencies.push_back(data);
+}
+
 template<typename Event>
 Resource::ReloaderWithEvent::ReloaderWithEvent(const std::function<void(Event*, ReloaderWithEvent*)>& pred, const std::function<Loader*()>& creator, int priority):
 m_creator(creator)
@@ -609,6 +889,9 @@ m_creator(creator)
 template<typename T>
 std::mutex SingletonResource<T>::s_mutex;
 
+template<typename T>
+std::atomic<ResourceData*> SingletonResource<T>::s_data{ nullptr };
+
 template<typename T>
 T* SingletonResource<T>::getSingleton()
 {
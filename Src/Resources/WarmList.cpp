@@ -0,0 +1,146 @@
+#include "stdafx.h"
+#include "WarmList.h"
+
+WarmList::WarmList():
+m_start(std::chrono::high_resolution_clock::now())
+{
+
+}
+
+void WarmList::registerType(StringView type, Prefetcher&& prefetcher)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	m_prefetchers[type.str()] = std::move(prefetcher);
+}
+
+void WarmList::registerBatch(StringView type, BatchPrefetcher&& prefetcher)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	m_batchPrefetchers[type.str()] = std::move(prefetcher);
+}
+
+void WarmList::load(StringView path, float recordSeconds)
+{
+	std::vector<Entry> entries;
+	std::map<std::string, Prefetcher> prefetchers;
+	std::map<std::string, BatchPrefetcher> batchPrefetchers;
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_path = path.str();
+		m_recordSeconds = recordSeconds;
+		prefetchers = m_prefetchers;
+		batchPrefetchers = m_batchPrefetchers;
+	}
+
+	std::ifstream f(path.c_str());
+	std::string line;
+	while (std::getline(f, line))
+	{
+		std::size_t tab = line.find('\t');
+		if (tab != std::string::npos)
+			entries.push_back({ line.substr(0, tab), line.substr(tab + 1) });
+	}
+
+	for (const auto& batch : batchPrefetchers)
+	{
+		std::vector<std::string> keys;
+		for (const Entry& entry : entries)
+		{
+			if (entry.m_type == batch.first)
+				keys.push_back(entry.m_key);
+		}
+		if (!keys.empty())
+			batch.second(keys);
+	}
+
+	// creating them might record or hit, don't hold the lock
+	std::vector<std::pair<Hold, ResourceData*>> holds;
+	for (const Entry& entry : entries)
+	{
+		auto it = prefetchers.find(entry.m_type);
+		if (it == prefetchers.end())
+			continue;
+
+		ResourceData* data = nullptr;
+		std::shared_ptr<void> ptr = it->second(entry.m_key, &data);
+		holds.push_back({ { entry, std::move(ptr) }, data });
+	}
+
+	LOG_F(INFO, "Prefetching %d of %d resources from \"%s\"\n", (int)holds.size(), (int)entries.size(), path.c_str());
+
+	std::lock_guard<std::mutex> l(m_mutex);
+	for (auto& hold : holds)
+	{
+		m_held[hold.second] = m_holds.size();
+		m_holds.push_back(std::move(hold.first));
+	}
+}
+
+bool WarmList::isRecording() const
+{
+	return m_recording;
+}
+
+void WarmList::record(StringView type, const std::string& key)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	if (m_recording)
+		recordLocked({ type.str(), key });
+}
+
+void WarmList::hit(ResourceData* data)
+{
+	// a prefetched resource was needed after all, keep it in the next list
+	std::lock_guard<std::mutex> l(m_mutex);
+	auto it = m_held.find(data);
+	if (m_recording && it != m_held.end())
+		recordLocked(m_holds[it->second].m_entry);
+}
+
+void WarmList::recordLocked(const Entry& entry)
+{
+	// m_mutex must be locked
+	if (m_recordedKeys.insert(entry.m_type + '\t' + entry.m_key).second)
+		m_recorded.push_back(entry);
+}
+
+void WarmList::update()
+{
+	if (!m_recording)
+		return;
+
+	std::chrono::duration<float> elapsed = std::chrono::high_resolution_clock::now() - m_start;
+	if (elapsed.count() < m_recordSeconds)
+		return;
+
+	std::vector<Hold> holds;
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_recording = false;
+		save();
+
+		std::swap(holds, m_holds);
+		m_held.clear();
+		m_recorded.clear();
+		m_recordedKeys.clear();
+	}
+
+	// released outside the lock, whatever nobody picked up is freed or cached by the resource manager
+}
+
+void WarmList::save()
+{
+	// m_mutex must be locked
+	if (m_path.empty())
+		return;
+
+	std::ofstream f(m_path, std::ios_base::trunc);
+	if (!f.is_open())
+	{
+		LOG_F(ERROR, "Unable to save warm list \"%s\"\n", m_path.c_str());
+		return;
+	}
+
+	for (const Entry& entry : m_recorded)
+		f << entry.m_type << '\t' << entry.m_key << '\n';
+}
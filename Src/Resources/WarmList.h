@@ -0,0 +1,59 @@
+#pragma once
+
+#include "../Misc/StringView.h"
+
+struct ResourceData;
+
+// shared resources a session requested while booting, prefetched on the next start so boot is mostly cache hits
+class WarmList
+{
+public:
+	// creates a ResourcePtr from a key, the result keeps it alive
+	typedef std::function<std::shared_ptr<void>(const std::string& key, ResourceData** data)> Prefetcher;
+	// gets all of a type's keys before their resources are created, to start their I/O in one go
+	typedef std::function<void(const std::vector<std::string>& keys)> BatchPrefetcher;
+
+public:
+	WarmList();
+
+	void registerType(StringView type, Prefetcher&&);
+	void registerBatch(StringView type, BatchPrefetcher&&);
+
+	// prefetches the list saved at path and saves this session's list there after recordSeconds
+	void load(StringView path, float recordSeconds);
+
+	bool isRecording() const;
+	void record(StringView type, const std::string& key); // a new shared resource was requested
+	void hit(ResourceData*); // an existing one was found by its shared hash
+
+	void update();
+
+protected:
+	struct Entry
+	{
+		std::string m_type, m_key;
+	};
+
+	struct Hold
+	{
+		Entry m_entry;
+		std::shared_ptr<void> m_ptr;
+	};
+
+	void recordLocked(const Entry&);
+	void save();
+
+protected:
+	mutable std::mutex m_mutex;
+	std::atomic<bool> m_recording{ true };
+	std::chrono::high_resolution_clock::time_point m_start;
+	float m_recordSeconds{ 10.0f };
+	std::string m_path;
+
+	std::map<std::string, Prefetcher> m_prefetchers;
+	std::map<std::string, BatchPrefetcher> m_batchPrefetchers;
+	std::vector<Entry> m_recorded; // in the order they were first requested
+	std::set<std::string> m_recordedKeys;
+	std::vector<Hold> m_holds; // prefetched resources, released once recording stops
+	std::unordered_map<ResourceData*, std::size_t> m_held;
+};
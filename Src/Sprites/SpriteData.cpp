@@ -3,6 +3,9 @@
 #include "../Files/FileManager.h"
 #include "../Files/File.h"
 #include "../Rendering/Texture.h"
+#include "../Rendering/TextureAtlas.h"
+#include "../Files/CookedAsset.h"
+#include "../Files/DerivedCache.h"
 #include "../Misc/Misc.h"
 #include "stb_rect_pack.h"
 
@@ -22,53 +25,30 @@ SpriteData::~SpriteData()
 		delete it->m_texture;*/
 }
 
-struct WorkingData
+struct GifDecoder
 {
 	int m_mode;
-	SpriteData* m_sprite;
+	std::vector<char> m_canvas;
+	const SpriteData::GifFrameCallback* m_onFrame;
 };
 
 static void frame(void* ud, GIF_WHDR* whdr)
 {
 	CHECK_F(whdr->mode == GIF_NONE || whdr->mode == GIF_CURR || whdr->mode == GIF_BKGD); // TODO: GIF_PREV = init with the data from two frames previous
-	WorkingData* workingData = static_cast<WorkingData*>(ud);
-	SpriteData* sprite = workingData->m_sprite;
-	SpriteData::FrameData data;
-	data.m_duration = (float)whdr->time / 100.0f;
-	data.m_texture = ResourcePtr<Rendering::Texture>(NewPtr);
+	GifDecoder* decoder = static_cast<GifDecoder*>(ud);
 
 	// build RGBA data
 	struct RGBA { unsigned char r, g, b, a; };
-	int pixelSize = sizeof(RGBA);
 	int width = whdr->xdim, height = whdr->ydim;
-	data.m_texture->setSoftware(width, height, pixelSize);
-	char* textureData = (char*)data.m_texture->map();
-
+	std::vector<char>& canvas = decoder->m_canvas;
 	if (whdr->ifrm == 0)
-	{
-		data.m_id = 0;
-		data.m_time = 0;
-		memset(textureData, 0x5A, width * height * pixelSize);
-	}
-	else
-	{
-		const SpriteData::FrameData& prev = sprite->m_frames[whdr->ifrm - 1];
-		if (workingData->m_mode == GIF_CURR)
-		{
-			// init with previous frame
-			void* prevData = prev.m_texture->map();
-			memcpy(textureData, prevData, width * height * pixelSize);
-			prev.m_texture->unmap();
-		}
-
-		data.m_time = prev.m_time + prev.m_duration;
-		data.m_id = prev.m_id + 1;
-		
-	}
+		canvas.assign(width * height * sizeof(RGBA), 0x5A);
+	else if (decoder->m_mode != GIF_CURR)
+		std::fill(canvas.begin(), canvas.end(), 0); // otherwise init with previous frame
 
 	for (int y = 0; y < whdr->fryd; y++)
 	{
-		RGBA* current = (RGBA*)&textureData[(((y + whdr->fryo) * width) + whdr->frxo) * sizeof(RGBA)];
+		RGBA* current = (RGBA*)&canvas[(((y + whdr->fryo) * width) + whdr->frxo) * sizeof(RGBA)];
 
 		for (int x = 0; x < whdr->frxd; x++)
 		{
@@ -84,39 +64,189 @@ static void frame(void* ud, GIF_WHDR* whdr)
 		}
 	}
 
-	data.m_texture->unmap();
-	sprite->addFrame(std::move(data));
-	workingData->m_mode = whdr->mode;
+	(*decoder->m_onFrame)(width, height, (float)whdr->time / 100.0f, canvas.data());
+	decoder->m_mode = whdr->mode;
+}
+
+void SpriteData::decodeGif(StringView contents, const GifFrameCallback& onFrame)
+{
+	GifDecoder decoder{ 0, {}, &onFrame };
+	GIF_Load(const_cast<char*>(contents.c_str()), (long)contents.size(), frame, nullptr, &decoder, 0);
 }
 
 bool SpriteData::loadFromGif(ResourcePtr<File> f, Rendering::Device& d)
 {
-	std::tuple<int, std::string> error;
-	std::size_t size = f->getSize();
-	const char* content = f->getContents();
+	addGifFrames(f->getContents());
+	return true;
+}
+
+void SpriteData::addGifFrames(StringView contents)
+{
+	decodeGif(contents, [this](int width, int height, float duration, const char* rgba) {
+		FrameData data;
+		data.m_id = (int)m_frames.size();
+		data.m_time = m_frames.empty() ? 0.0f : m_frames.back().m_time + m_frames.back().m_duration;
+		data.m_duration = duration;
+		data.m_texture = ResourcePtr<Rendering::Texture>(NewPtr);
+		data.m_texture->setSoftware(width, height, 4);
+		memcpy(data.m_texture->map(), rgba, width * height * 4);
+		data.m_texture->unmap();
+		m_frames.push_back(std::move(data));
+	});
+	buildFrameTable();
+}
+
+bool SpriteData::loadCooked(StringView contents, const std::string& name)
+{
+	typedef CookedAsset::Sprite Cooked;
+	const Cooked* sprite = (const Cooked*)CookedAsset::read(contents, CookedAsset::Type::Sprite, sizeof(Cooked));
+	if (!sprite)
+		return false;
+
+	std::size_t frameSize = (std::size_t)sprite->m_width * sprite->m_height * sprite->m_pixelSize;
+	std::size_t atlasSize = (std::size_t)sprite->m_atlasWidth * sprite->m_atlasHeight * sprite->m_pixelSize;
+	std::size_t size = sizeof(CookedAsset::Header) + sizeof(Cooked) + sprite->m_frameCount * (sizeof(CookedAsset::SpriteFrame) + frameSize) + atlasSize;
+	if (contents.size() < size)
+	{
+		LOG_F(ERROR, "Cooked sprite \"%s\" is truncated\n", name.c_str());
+		return false;
+	}
+
+	// already decoded and packed, just copy
+	const CookedAsset::SpriteFrame* frames = (const CookedAsset::SpriteFrame*)(sprite + 1);
+	const char* texels = (const char*)(frames + sprite->m_frameCount);
+	std::vector<std::tuple<glm::vec2, glm::vec2>> uvs;
+	for (std::uint32_t i = 0; i < sprite->m_frameCount; i++)
+	{
+		FrameData data;
+		data.m_id = (int)i;
+		data.m_time = frames[i].m_time;
+		data.m_duration = frames[i].m_duration;
+		data.m_texture = ResourcePtr<Rendering::Texture>(NewPtr);
+		data.m_texture->setSoftware(sprite->m_width, sprite->m_height, sprite->m_pixelSize);
+		memcpy(data.m_texture->map(), texels + i * frameSize, frameSize);
+		data.m_texture->unmap();
+		m_frames.push_back(std::move(data));
+
+		uvs.emplace_back(glm::vec2(frames[i].m_uv1[0], frames[i].m_uv1[1]), glm::vec2(frames[i].m_uv2[0], frames[i].m_uv2[1]));
+	}
+	buildFrameTable();
 
-	WorkingData data{0, this};
-	GIF_Load(const_cast<char*>(content), (long)size, frame, nullptr, &data, 0);
+	Rendering::TextureAtlas* atlas = new Rendering::TextureAtlas();
+	atlas->setPadding(sprite->m_atlasPadding);
+	atlas->setLayout(sprite->m_atlasWidth, sprite->m_atlasHeight, sprite->m_pixelSize, texels + sprite->m_frameCount * frameSize, uvs);
+	m_cookedAtlas = g_resourceManager->addLoadedResource(atlas, "Sprite Atlas");
 	return true;
 }
 
 void SpriteData::addFrame(const FrameData& fd)
 {
 	m_frames.push_back(fd);
+	buildFrameTable();
+}
+
+void SpriteData::buildFrameTable()
+{
+	m_frameEnds.clear();
+	for (const FrameData& frame : m_frames)
+		m_frameEnds.push_back(frame.m_time + frame.m_duration);
+
+	float duration = getDuration();
+	std::size_t buckets = std::max<std::size_t>(m_frames.size(), 1);
+	m_bucketScale = duration > 0.0f ? buckets / duration : 0.0f;
+	m_frameBuckets.assign(buckets, { std::numeric_limits<std::uint32_t>::max(), 0 });
+
+	// getBucket is monotonic, so every time in a frame lands in a bucket between those of its start and end
+	for (std::uint32_t i = 0; i < (std::uint32_t)m_frames.size(); i++)
+	{
+		if (m_frames[i].m_duration <= 0.0f)
+			continue; // never sampled
+		for (std::size_t b = getBucket(m_frames[i].m_time), last = getBucket(m_frameEnds[i]); b <= last; b++)
+		{
+			m_frameBuckets[b].first = std::min(m_frameBuckets[b].first, i);
+			m_frameBuckets[b].second = std::max(m_frameBuckets[b].second, i);
+		}
+	}
+
+	for (auto& bucket : m_frameBuckets)
+	{
+		if (bucket.first > bucket.second)
+			bucket = { 0, (std::uint32_t)m_frames.size() - 1 }; // gaps in the timeline, search everything
+	}
+}
+
+std::size_t SpriteData::getBucket(float time) const
+{
+	return std::min((std::size_t)std::max(time * m_bucketScale, 0.0f), m_frameBuckets.size() - 1);
 }
 
 const SpriteData::FrameData& SpriteData::getFrame(float time) const
 {
-	float totalDuration = getDuration();
-	while (time >= totalDuration)
-		time -= totalDuration;
+	return m_frames[getFrameIndex(time)];
+}
 
-	std::size_t i = 0;
-	std::vector<FrameData>::const_iterator it = m_frames.begin();
-	while (time >= it->m_time + it->m_duration)
-		++it;
+std::size_t SpriteData::getFrameIndex(float time) const
+{
+	CHECK_F(!m_frames.empty());
+	float duration = getDuration();
+	if (!(duration > 0.0f))
+		return 0;
 
-	return *it;
+	if (time >= duration || time < 0.0f)
+	{
+		time = std::fmod(time, duration);
+		if (time < 0.0f)
+			time += duration;
+	}
+
+	// first frame that ends after time, same as walking the frames from the start
+	const std::pair<std::uint32_t, std::uint32_t>& bucket = m_frameBuckets[getBucket(time)];
+	auto it = std::upper_bound(m_frameEnds.begin() + bucket.first, m_frameEnds.begin() + bucket.second + 1, time);
+	return std::min<std::size_t>(it - m_frameEnds.begin(), m_frames.size() - 1);
+}
+
+void SpriteData::testSampler()
+{
+	using namespace std::chrono;
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> delay(0.01f, 0.5f), loops(0.0f, 3.0f);
+	for (int frameCount : { 1, 2, 7, 64, 1000 })
+	{
+		// uneven delays and a few zero length frames, like gifs have
+		SpriteData data;
+		float start = 0.0f;
+		for (int i = 0; i < frameCount; i++)
+		{
+			float length = (frameCount > 2 && i % 5 == 3) ? 0.0f : delay(random);
+			data.m_frames.push_back({ i, start, length, ResourcePtr<Rendering::Texture>(EmptyPtr) });
+			start += length;
+		}
+		data.buildFrameTable();
+
+		const int samples = 100000;
+		std::vector<float> times(samples);
+		for (float& t : times)
+			t = loops(random) * data.getDuration();
+
+		std::vector<std::size_t> linear(samples), sampled(samples);
+		auto linearStart = high_resolution_clock::now();
+		for (int s = 0; s < samples; s++)
+		{
+			float t = std::fmod(times[s], data.getDuration());
+			std::size_t i = 0;
+			while (t >= data.m_frames[i].m_time + data.m_frames[i].m_duration)
+				++i;
+			linear[s] = i;
+		}
+		auto sampledStart = high_resolution_clock::now();
+		for (int s = 0; s < samples; s++)
+			sampled[s] = data.getFrameIndex(times[s]);
+		auto end = high_resolution_clock::now();
+
+		CHECK_F(linear == sampled, "getFrameIndex differs from the linear search with %d frames", frameCount);
+		LOG_F(INFO, "%d frames, %d samples: linear %.3fms, table %.3fms\n", frameCount, samples,
+			duration<float, std::milli>(sampledStart - linearStart).count(), duration<float, std::milli>(end - sampledStart).count());
+	}
 }
 
 float SpriteData::getDuration() const
@@ -141,20 +271,31 @@ StringView SpriteData::getPath() const
 	return m_path;
 }
 
+std::size_t SpriteData::getCpuSize() const
+{
+	return sizeof(SpriteData) + m_frames.capacity() * sizeof(FrameData) + m_path.capacity();
+}
+
+const ResourcePtr<Rendering::TextureAtlas>& SpriteData::getCookedAtlas() const
+{
+	return m_cookedAtlas;
+}
+
 SpriteData::SpriteDataLoader::SpriteDataLoader(StringView filePath) :
 	m_file(NewPtr, filePath)
 {
-
+	dependsOn(m_file);
 }
 
 SpriteData* SpriteData::SpriteDataLoader::load(std::tuple<int, std::string>* error)
 {
-	if (!ready(error, m_file))
+	if (!ready(error, m_file) || isCancelled())
 		return nullptr;
 
 	SpriteData* data = new SpriteData;
-	std::size_t size = m_file->getSize();
-	const char* content = m_file->getContents();
+	if (data->loadCooked(m_file->getContents(), m_file->getPath()))
+		return data;
+
 	std::string ext = FileManager::extension(m_file->getPath());
 	if (ext == "png")
 	{
@@ -162,8 +303,15 @@ SpriteData* SpriteData::SpriteDataLoader::load(std::tuple<int, std::string>* err
 	}
 	else if(ext == "gif")
 	{
-		WorkingData workingData{ 0, data };
-		GIF_Load(const_cast<char*>(content), (long)size, frame, nullptr, &workingData, 0);
+		// decoded and packed once, then copied straight out of the DerivedCache
+		ResourcePtr<DerivedCache> cache;
+		DerivedCache::Key key = DerivedCache::key("sprite", CookedAsset::Version, m_file->getContents());
+		std::vector<char> cooked;
+		if (!cache->get(key, &cooked) && CookedAsset::cookSprite(m_file->getContents(), &cooked))
+			cache->put(key, StringView(cooked.data(), cooked.data() + cooked.size()));
+
+		if (cooked.empty() || !data->loadCooked(StringView(cooked.data(), cooked.data() + cooked.size()), m_file->getPath()))
+			data->addGifFrames(m_file->getContents());
 	}
 	else if(ext == "py")
 	{
@@ -10,6 +10,7 @@ namespace Rendering
 {
 	class Device;
 	class Texture;
+	class TextureAtlas;
 }
 
 class SpriteData : public Resource
@@ -30,14 +31,25 @@ public:
 
 	bool loadFromGif(ResourcePtr<File>, Rendering::Device&);
 
-	void addFrame(const FrameData&);
+	void addFrame(const FrameData&); // rebuilds the sampler, loaders add all their frames first and build it once
 
 	const FrameData& getFrame(float time) const;
+	std::size_t getFrameIndex(float time) const; // time loops, O(1) for evenly timed frames and O(log n) at worst
 	float getDuration() const;
 
 	glm::vec2 getDimensions() const;
 	StringView getPath() const;
 
+	std::size_t getCpuSize() const override; // frame textures are counted on their own
+
+	static void testSampler(); // headless, getFrameIndex against the old linear search
+
+	const ResourcePtr<Rendering::TextureAtlas>& getCookedAtlas() const; // empty unless it was packed offline
+
+	// calls onFrame with every frame composited into width * height RGBA pixels
+	typedef std::function<void(int width, int height, float duration, const char* rgba)> GifFrameCallback;
+	static void decodeGif(StringView contents, const GifFrameCallback& onFrame);
+
 public:
 	class SpriteDataLoader : public Loader
 	{
@@ -55,6 +67,18 @@ public:
 		return new SpriteDataLoader(std::forward<Ts>(args)...);
 	}
 
+protected:
+	void addGifFrames(StringView contents);
+	bool loadCooked(StringView contents, const std::string& name);
+	void buildFrameTable();
+	std::size_t getBucket(float time) const;
+
 protected:
 	std::string m_path;
+
+	// sampler, see buildFrameTable(). The loop is cut into one bucket per frame, each knows the frames overlapping it
+	std::vector<float> m_frameEnds; // m_time + m_duration of every frame
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> m_frameBuckets; // first and last frame
+	float m_bucketScale{ 0.0f };
+	ResourcePtr<Rendering::TextureAtlas> m_cookedAtlas{ EmptyPtr };
 };
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "SpriteData.h"
 #include "../Misc/Misc.h"
 #include "../Managers/EventManager.h"
+#include "../Threading/MainThreadQueue.h"
 #include "../Rendering/Unit.h"
 #include "../Rendering/RenderingDevice.h"
 #include "../Rendering/TextureAtlas.h"
@@ -24,96 +25,128 @@ SpriteManager::~SpriteManager()
 
 SpriteId SpriteManager::getSprite(const char* path)
 {
-	SpriteId sprite;
-	std::string normalizedPath = normalizePath(path);
-	auto namedIt = m_nameSprites.find(normalizedPath);
-	if (namedIt == m_nameSprites.end())
-	{
-		// load it
-		ResourcePtr<SpriteData> data{ NewPtr, normalizedPath.c_str() };
-		m_nameSprites.insert(decltype(m_nameSprites)::value_type(normalizedPath, data));
-		m_nextSpriteId.m_value++;
-		sprite = m_nextSpriteId;
-		m_idSprites.insert(decltype(m_idSprites)::value_type(sprite, data));
-
-		ResourcePtr<EventManager> events;
-		events->addListener<ResourceStateChanged>([this, data, normalizedPath](ResourceStateChanged* c) {
-			if (data == c->m_resourceData)
-			{
-				onSpriteLoaded(data, normalizedPath);
-				// TODO: discardListener() when sprite gets deleted
-				//c->discardListener();
-			}
-		});
-	}
-
-	if (sprite)
-		return sprite;
-	
-	// find it
-	for (auto& it : m_idSprites)
-	{
-		if (it.second == namedIt->second)
-			return it.first;
-	}
-
-	return { }; // fail
+	StringId name = StringId::path(path);
+	auto namedIt = m_nameSprites.find(name);
+	if (namedIt != m_nameSprites.end())
+		return namedIt->second;
+
+	// load it
+	ResourcePtr<SpriteData> data{ NewPtr, name.c_str() };
+	SpriteId sprite = addSprite(data);
+	m_nameSprites.emplace(name, sprite);
+
+	ResourcePtr<EventManager> events;
+	events->addListener<ResourceStateChanged>([this, sprite, data, name](ResourceStateChanged* c) {
+		if (data == c->m_resourceData)
+		{
+			// the frames may have changed, clocks see it as loading until the atlas catches up
+			m_spriteTable[sprite.m_value].m_frameCount = 0;
+
+			// relays out the whole atlas, spread over frames when many sprites land at once
+			ResourcePtr<MainThreadQueue> queue;
+			queue->post(MainThreadQueue::Priority::Normal, [this, sprite, data, name]() { onSpriteLoaded(sprite, data, name); }, "Sprite atlas");
+			// TODO: discardListener() when sprite gets deleted
+			//c->discardListener();
+		}
+	});
+	return sprite;
 }
 
 SpriteId SpriteManager::getSprite(ResourcePtr<Rendering::Texture> texture)
 {
 	SpriteData* data = new SpriteData();
 	data->addFrame({ 0, 0, std::numeric_limits<float>::max(), texture });
-	m_nextSpriteId.m_value++;
-	SpriteId sprite = m_nextSpriteId;
 
 	ResourcePtr<SpriteData> dataPtr{ TakeOwnershipPtr, data };
-	m_idSprites.insert(decltype(m_idSprites)::value_type(sprite, dataPtr));
+	SpriteId sprite = addSprite(dataPtr);
+	onSpriteLoaded(sprite, dataPtr, StringId());
+	return sprite;
+}
+
+SpriteId SpriteManager::addSprite(const ResourcePtr<SpriteData>& data)
+{
+	m_nextSpriteId.m_value++;
+	SpriteId sprite = m_nextSpriteId;
+	m_idSprites.insert(decltype(m_idSprites)::value_type(sprite, data));
 
-	onSpriteLoaded(dataPtr, "");
+	if (m_spriteTable.size() <= sprite.m_value)
+		m_spriteTable.resize(sprite.m_value + 1); // m_data is set once it's loaded, getting it now would wait for the load
 	return sprite;
 }
 
 std::tuple<SpriteData*, Rendering::TextureAtlas*> SpriteManager::getSpriteData(SpriteId id)
 {
-	auto it = m_idSprites.find(id);
-	return it == m_idSprites.end() ? 
-		std::tuple<SpriteData*, Rendering::TextureAtlas*>( nullptr, nullptr ) :
-		std::tuple<SpriteData*, Rendering::TextureAtlas*>{ &(*it->second), findTexture(it->second) };
+	const SpriteEntry* entry = getSpriteEntry(id);
+	if (!entry)
+		return std::tuple<SpriteData*, Rendering::TextureAtlas*>(nullptr, nullptr);
+
+	Rendering::TextureAtlas* atlas = entry->m_frameCount ? m_atlasTable[m_regions[entry->m_firstRegion].m_atlas] : nullptr;
+	return std::tuple<SpriteData*, Rendering::TextureAtlas*>{ !entry->m_data ? nullptr : entry->m_data.get(), atlas };
 }
 
-Rendering::TextureAtlas* SpriteManager::findTexture(const ResourcePtr<SpriteData>& data)
+void SpriteManager::updateRegions(SpriteId id, std::uint32_t atlasIndex)
 {
-	for (auto& atlasData : m_atlases)
+	SpriteEntry& entry = m_spriteTable[id.m_value];
+	const std::vector<SpriteData::FrameData>& frames = entry.m_data->m_frames;
+	std::uint32_t frameCount = (std::uint32_t)frames.size();
+	if (entry.m_regionCount < frameCount)
 	{
-		for (auto& sprite : atlasData->m_sprites)
-			if (sprite == data)
-				return atlasData->m_atlas;
+		// more frames after a reload. The last range grows in place, any other is left unused and a new one added
+		if (entry.m_regionCount == 0 || entry.m_firstRegion + entry.m_regionCount != m_regions.size())
+			entry.m_firstRegion = (std::uint32_t)m_regions.size();
+		entry.m_regionCount = frameCount;
+		m_regions.resize(entry.m_firstRegion + frameCount);
 	}
+	entry.m_frameCount = frameCount;
 
-	return nullptr;
+	Rendering::TextureAtlas* atlas = m_atlasTable[atlasIndex];
+	for (std::size_t i = 0; i < frames.size(); i++)
+	{
+		glm::vec2 uv1, uv2;
+		std::tie(uv1, uv2) = atlas->getUV(frames[i].m_id);
+		m_regions[entry.m_firstRegion + i] = { atlasIndex, { uv1.x, uv1.y, uv2.x, uv2.y }, { (float)frames[i].m_texture->getWidth(), (float)frames[i].m_texture->getHeight() } };
+	}
 }
 
-void SpriteManager::onSpriteLoaded(const ResourcePtr<SpriteData>& sprite, StringView id)
+void SpriteManager::onSpriteLoaded(SpriteId spriteId, const ResourcePtr<SpriteData>& sprite, StringId id)
 {
 	std::shared_ptr<AtlasData> atlasData = nullptr;
-	auto it = std::find_if(m_atlases.begin(), m_atlases.end(), [&](const std::shared_ptr<AtlasData>& a) { return a->m_id == id.str(); });
+	auto it = std::find_if(m_atlases.begin(), m_atlases.end(), [&](const std::shared_ptr<AtlasData>& a) { return a->m_id == id; });
 	if (it == m_atlases.end())
 	{
 		m_atlases.push_back(std::make_shared<AtlasData>(new Rendering::TextureAtlas));
 		atlasData = m_atlases.back();
+		it = m_atlases.end() - 1;
 	}
 	else
 	{
 		atlasData = *it;
 		atlasData->m_atlas = g_resourceManager->addLoadedResource(new Rendering::TextureAtlas, "Texture Atlas");
 	}
+	std::uint32_t atlasIndex = (std::uint32_t)(it - m_atlases.begin());
 	
-	atlasData->m_atlas->addSprite(sprite);
-	atlasData->m_atlas->setPadding(m_atlases.size() <= 1 ? 0 : 2);
-	atlasData->m_atlas->layoutAtlas();
+	if (sprite->getCookedAtlas())
+	{
+		atlasData->m_atlas = sprite->getCookedAtlas(); // packed offline
+	}
+	else
+	{
+		atlasData->m_atlas->addSprite(sprite);
+		atlasData->m_atlas->setPadding(m_atlases.size() <= 1 ? 0 : 2);
+		atlasData->m_atlas->layoutAtlas();
+	}
 	atlasData->m_sprites.push_back(sprite);
-	atlasData->m_id = id.str();
+	atlasData->m_spriteIds.push_back(spriteId);
+	atlasData->m_id = id;
+
+	m_spriteTable[spriteId.m_value].m_data = sprite;
+
+	// only this atlas moved, everything in it gets its regions again
+	m_atlasTable.resize(m_atlases.size(), nullptr);
+	m_atlasTable[atlasIndex] = atlasData->m_atlas.get();
+	for (SpriteId s : atlasData->m_spriteIds)
+		updateRegions(s, atlasIndex);
+	m_atlasGeneration++;
 
 	ResourcePtr<Rendering::Device> device;
 	Rendering::Unit upload = device->createUnit();
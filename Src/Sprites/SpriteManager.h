@@ -2,6 +2,7 @@
 
 #include "../Resources/ResourceManager.h"
 #include "../Misc/Misc.h"
+#include "../Misc/StringId.h"
 #include "../ECS/ECS.h"
 
 class SpriteData;
@@ -10,6 +11,23 @@ namespace Rendering { class TextureAtlas; }
 struct SpriteId : public OpaqueHandle<SpriteManager, unsigned int> { };
 class SpriteManager : public SingletonResource<SpriteManager>
 {
+public:
+	// where a frame ended up, see getRegion()
+	struct Region
+	{
+		std::uint32_t m_atlas; // index into getAtlasTable()
+		glm::vec4 m_uv; // top left xy, bottom right zw
+		glm::vec2 m_size; // in pixels
+	};
+
+	struct SpriteEntry
+	{
+		ResourcePtr<SpriteData> m_data{ EmptyPtr }; // empty until it's loaded, follows reloads
+		std::uint32_t m_firstRegion{ 0 };
+		std::uint32_t m_frameCount{ 0 }; // 0 until it's in an atlas, and again while it reloads
+		std::uint32_t m_regionCount{ 0 }; // reserved at m_firstRegion, reloads with as many frames or fewer reuse it
+	};
+
 public:
 	SpriteManager();
 	~SpriteManager();
@@ -17,27 +35,42 @@ public:
 	SpriteId getSprite(const char* path);
 	SpriteId getSprite(ResourcePtr<Rendering::Texture> texture);
 	std::tuple<SpriteData*, Rendering::TextureAtlas*> getSpriteData(SpriteId);
+	unsigned int getAtlasGeneration() const { return m_atlasGeneration; } // changes whenever an atlas is laid out, uvs from before are stale
+
+	// O(1), the tables are dense and only change on the main thread when an atlas is laid out.
+	// Region indices stay valid until the next generation, the atlas table only grows
+	const SpriteEntry* getSpriteEntry(SpriteId id) const { return id.m_value < m_spriteTable.size() ? &m_spriteTable[id.m_value] : nullptr; }
+	std::uint32_t getRegionIndex(const SpriteEntry& entry, std::size_t frame) const { return entry.m_firstRegion + (std::uint32_t)frame; }
+	const std::vector<Region>& getRegions() const { return m_regions; }
+	const std::vector<Rendering::TextureAtlas*>& getAtlasTable() const { return m_atlasTable; }
 
 	void imgui();
 
 protected:
-	void onSpriteLoaded(const ResourcePtr<SpriteData>&, StringView id);
-	Rendering::TextureAtlas* findTexture(const ResourcePtr<SpriteData>&);
+	void onSpriteLoaded(SpriteId, const ResourcePtr<SpriteData>&, StringId name);
+	SpriteId addSprite(const ResourcePtr<SpriteData>&);
+	void updateRegions(SpriteId, std::uint32_t atlas);
 
 protected:
 	std::map<SpriteId, ResourcePtr<SpriteData>> m_idSprites;
-	std::map<std::string, ResourcePtr<SpriteData>> m_nameSprites;
+	std::unordered_map<StringId, SpriteId> m_nameSprites;
 	
 	struct AtlasData
 	{
-		std::string m_id;
+		StringId m_id;
 		ResourcePtr<Rendering::TextureAtlas> m_atlas;
 		std::vector<ResourcePtr<SpriteData>> m_sprites;
+		std::vector<SpriteId> m_spriteIds;
 		AtlasData(Rendering::TextureAtlas*);
 	};
 	std::vector<std::shared_ptr<AtlasData>> m_atlases;
 
+	std::vector<SpriteEntry> m_spriteTable; // indexed by SpriteId
+	std::vector<Region> m_regions;
+	std::vector<Rendering::TextureAtlas*> m_atlasTable; // same order as m_atlases
+
 	SpriteId m_nextSpriteId;
+	unsigned int m_atlasGeneration{ 1 };
 };
 
 namespace Meta{
@@ -15,6 +15,11 @@
 #include "../Scene/TransformSystem.h"
 #include "../Managers/EventManager.h"
 #include "../Managers/DebugManager.h"
+#include "../imgui/ImGuiManager.h"
+#include "../Threading/ThreadPool.h"
+#include <immintrin.h>
+
+static const std::size_t s_generateChunk = 4096; // sprites per ThreadPool task
 
 SpriteSystem::SpriteSystem():
 m_vertexShader(EmptyPtr),
@@ -22,34 +27,35 @@ m_fragmentShader(EmptyPtr)
 {
 	m_components->addComponentType<SpriteComponent>();
 
-	int spriteCount = 999;
-	m_vertexBuffer = std::make_shared<Rendering::Buffer>(Rendering::Buffer::Vertex, Rendering::Buffer::Mapped, sizeof(Vertex) * 4 * spriteCount);
-	m_vertexBuffer->setFormat({
-			{vk::Format::eR32G32B32Sfloat, sizeof(glm::vec3)},
-			{vk::Format::eR32G32Sfloat, sizeof(glm::vec2)},
-		}, sizeof(Vertex));
-
-	m_indexBuffer = std::make_shared<Rendering::Buffer>(Rendering::Buffer::Index, Rendering::Buffer::Mapped, sizeof(short) * 4);
+	// corners of the triangle strip, same order getVertices() uses
+	m_quadBuffer = std::make_shared<Rendering::Buffer>(Rendering::Buffer::Vertex, Rendering::Buffer::Mapped, sizeof(glm::vec2) * 4);
 	{
-		short* index = (short*)m_indexBuffer->map();
-		for (short i = 0; i < 4; i++)
-			index[i] = i;
-
-		m_indexBuffer->unmap();
+		glm::vec2* corner = (glm::vec2*)m_quadBuffer->map();
+		corner[0] = { 1.0f, -1.0f };
+		corner[1] = { 1.0f, 1.0f };
+		corner[2] = { -1.0f, -1.0f };
+		corner[3] = { -1.0f, 1.0f };
+		m_quadBuffer->unmap();
 	}
-	m_indexBuffer->setFormat({ {vk::Format::eR16Sint, sizeof(short)} }, sizeof(short));
+	m_quadBuffer->setFormat({ {vk::Format::eR32G32Sfloat, sizeof(glm::vec2)} }, sizeof(glm::vec2));
 
 	char vertexCode[] =
 		"#version 450 core\n"
-		"layout(location = 0) in vec3 aPos;\n"
-		"layout(location = 1) in vec2 aUV;\n"
+		"layout(location = 0) in vec2 aCorner;\n"
+		"layout(location = 1) in vec3 iPosition;\n"
+		"layout(location = 2) in vec2 iHalfSize;\n"
+		"layout(location = 3) in vec4 iUV;\n"
+		"layout(location = 4) in vec4 iColour;\n"
 		"layout(push_constant) uniform PushConsts{ mat4 vp; } pushConsts;\n"
 		"out gl_PerVertex{ vec4 gl_Position; };\n"
 		"layout(location = 0) out vec2 UV;\n"
+		"layout(location = 1) out vec4 Colour;\n"
 		"void main()\n"
 		"{\n"
-		"	gl_Position = pushConsts.vp * vec4(aPos.xyz, 1.0);\n"
-		"	UV = aUV;\n"
+		"	gl_Position = pushConsts.vp * vec4(iPosition + vec3(aCorner * iHalfSize, 0.0), 1.0);\n"
+		"	vec2 t = aCorner * 0.5 + 0.5;\n"
+		"	UV = vec2(mix(iUV.x, iUV.z, t.x), mix(iUV.w, iUV.y, t.y));\n"
+		"	Colour = iColour;\n"
 		"}";
 
 	 m_vertexShader = ResourcePtr<Rendering::Shader>(NewPtr, Rendering::Shader::Type::Vertex, vertexCode);
@@ -57,11 +63,12 @@ m_fragmentShader(EmptyPtr)
 	char pixelCode[] =
 		"#version 450 core\n"
 		"layout(location = 0) in vec2 UV;\n"
+		"layout(location = 1) in vec4 Colour;\n"
 		"layout(location = 0) out vec4 fColor; \n"
 		"layout(binding = 0) uniform sampler2D sTexture;\n"
 		"void main()\n"
 		"{\n"
-		"	fColor = texture(sTexture, UV.st);\n"
+		"	fColor = texture(sTexture, UV.st) * Colour;\n"
 		"}";
 
 	m_fragmentShader = ResourcePtr<Rendering::Shader>(NewPtr, Rendering::Shader::Type::Pixel, pixelCode);
@@ -78,18 +85,20 @@ SpriteSystem::~SpriteSystem()
 
 bool SpriteSystem::getVertices(std::array<Vertex, 4>* vertices, SpriteComponent* sprite, TransformComponent* transform) const
 {
-	ResourcePtr<SpriteManager> spriteManager;
-	std::tuple<SpriteData*, Rendering::TextureAtlas*> spriteData = spriteManager->getSpriteData(sprite->m_sprite);
-	if (!std::get<1>(spriteData))
+	// whatever process() showed last
+	if (sprite->m_clock < 0 || sprite->m_clock >= (int)m_clocks.size())
 		return false;
 
-	glm::vec2 uv1, uv2;
-	const SpriteData::FrameData& frame = std::get<0>(spriteData)->getFrame(sprite->m_time);
-	std::tie(uv1, uv2) = std::get<1>(spriteData)->getUV(frame.m_id);
+	const Clock& clock = m_clocks[sprite->m_clock];
+	if (clock.m_region < 0 || !(clock.m_sprite == sprite->m_sprite))
+		return false;
 
+	ResourcePtr<SpriteManager> spriteManager;
+	const SpriteManager::Region& region = spriteManager->getRegions()[clock.m_region];
+	glm::vec2 uv1(region.m_uv.x, region.m_uv.y), uv2(region.m_uv.z, region.m_uv.w);
 	glm::vec3 scale = transform->m_scale;
-	float halfWidth = (frame.m_texture->getWidth() / 2.0f) * scale.x;
-	float halfHeight = (frame.m_texture->getHeight() / 2.0f) * scale.y;
+	float halfWidth = (region.m_size.x / 2.0f) * scale.x;
+	float halfHeight = (region.m_size.y / 2.0f) * scale.y;
 
 	*vertices = { Vertex{ transform->m_position + glm::vec3{ halfWidth, -halfHeight, 0.0f }, { uv2.x, uv2.y } },
 		Vertex{ transform->m_position + glm::vec3{ halfWidth, halfHeight, 0.0f }, { uv2.x, uv1.y } },
@@ -99,70 +108,304 @@ bool SpriteSystem::getVertices(std::array<Vertex, 4>* vertices, SpriteComponent*
 	return true;
 }
 
-void SpriteSystem::process(float delta)
+int SpriteSystem::getClock(SpriteId sprite, int group)
+{
+	auto it = m_clockIds.find(std::make_tuple(sprite, group));
+	if (it != m_clockIds.end())
+		return it->second;
+
+	Clock clock;
+	clock.m_sprite = sprite;
+	clock.m_group = group;
+	sampleClock(clock); // advanceClocks has already run this frame, sprites on it show right away
+	m_clocks.push_back(clock);
+	m_clockIds.emplace(std::make_tuple(sprite, group), (int)m_clocks.size() - 1);
+	return (int)m_clocks.size() - 1;
+}
+
+void SpriteSystem::setClockSpeed(SpriteId sprite, int group, float speed)
+{
+	m_clocks[getClock(sprite, group)].m_speed = speed;
+}
+
+void SpriteSystem::resetClock(SpriteId sprite, int group)
 {
-	// TODO: use getVertices()
+	Clock& clock = m_clocks[getClock(sprite, group)];
+	clock.m_time = 0.0f;
+	clock.m_frameEnd = -1.0f; // resample on the next advance
+}
 
-	ResourcePtr<DebugManager> debugManager;
+void SpriteSystem::advanceClocks(float delta)
+{
 	ResourcePtr<SpriteManager> spriteManager;
+	unsigned int atlasGeneration = spriteManager->getAtlasGeneration();
+	m_frameStats.m_clocks = (int)m_clocks.size();
+	for (Clock& clock : m_clocks)
+	{
+		clock.m_time += delta * clock.m_speed;
+		if (clock.m_time >= clock.m_frameStart && clock.m_time < clock.m_frameEnd && clock.m_atlasGeneration == atlasGeneration && clock.m_region >= 0)
+			continue;
+
+		sampleClock(clock);
+	}
+}
+
+void SpriteSystem::sampleClock(Clock& clock)
+{
+	ResourcePtr<SpriteManager> spriteManager;
+	const SpriteManager::SpriteEntry* entry = spriteManager->getSpriteEntry(clock.m_sprite);
+	if (!entry || entry->m_frameCount == 0)
+	{
+		clock.m_region = -1;
+		return; // still loading, the time keeps running
+	}
+
+	SpriteData* data = entry->m_data.get();
+	if (data->m_frames.size() != entry->m_frameCount)
+	{
+		clock.m_region = -1;
+		return; // reloaded but its ResourceStateChanged hasn't come through yet
+	}
+
+	// wrapped here so the time never gets big enough to lose precision
+	float duration = data->getDuration();
+	if (duration > 0.0f && (clock.m_time >= duration || clock.m_time < 0.0f))
+	{
+		clock.m_time = std::fmod(clock.m_time, duration);
+		if (clock.m_time < 0.0f)
+			clock.m_time += duration;
+	}
+
+	std::size_t frameIndex = data->getFrameIndex(clock.m_time);
+	const SpriteData::FrameData& frame = data->m_frames[frameIndex];
+	clock.m_region = (int)spriteManager->getRegionIndex(*entry, frameIndex);
+	clock.m_frameStart = frame.m_time;
+	clock.m_frameEnd = frame.m_time + frame.m_duration;
+	clock.m_atlasGeneration = spriteManager->getAtlasGeneration();
+	m_frameStats.m_resampled++;
+}
+
+const SpriteSystem::Clock* SpriteSystem::findClock(SpriteComponent* sprite)
+{
+	if (sprite->m_clock < 0 || sprite->m_clock >= (int)m_clocks.size() ||
+		!(m_clocks[sprite->m_clock].m_sprite == sprite->m_sprite) || m_clocks[sprite->m_clock].m_group != sprite->m_clockGroup)
+	{
+		// a new sprite, or its sprite or group changed. It picks up the clock's current frame
+		sprite->m_clock = getClock(sprite->m_sprite, sprite->m_clockGroup);
+	}
+
+	return &m_clocks[sprite->m_clock];
+}
+
+void SpriteSystem::process(float delta)
+{
 	EntityIterator<TransformComponent, SpriteComponent> it(true);
-	Vertex* map = (Vertex*)m_vertexBuffer->map();
+	m_queued.clear();
+	m_inputs.clear();
+	m_frameStats = FrameStats();
+	advanceClocks(delta);
+
+	ResourcePtr<SpriteManager> spriteManager;
+	const std::vector<SpriteManager::Region>& regions = spriteManager->getRegions();
 	while (it.next())
 	{
-		auto sprite = it.get<SpriteComponent>();
-		sprite->m_time += delta;
-
-		std::tuple<SpriteData*, Rendering::TextureAtlas*> spriteData = spriteManager->getSpriteData(sprite->m_sprite);
-		if (!std::get<1>(spriteData))
+		SpriteComponent* sprite = it.get<SpriteComponent>();
+		const Clock* clock = findClock(sprite);
+		if (clock->m_region < 0)
 			continue; // still loading
 
-		glm::vec2 uv1, uv2;
-		const SpriteData::FrameData& frame = std::get<0>(spriteData)->getFrame(sprite->m_time);
-		std::tie(uv1, uv2) = std::get<1>(spriteData)->getUV(frame.m_id);
-
+		const SpriteManager::Region& region = regions[clock->m_region];
 		TransformComponent* transform = it.get<TransformComponent>();
-		const glm::vec3& scale = transform->m_scale;
-		float halfWidth = (frame.m_texture->getWidth() / 2.0f) * scale.x;
-		float halfHeight = (frame.m_texture->getHeight() / 2.0f) * scale.y;
+		m_queued.push_back({ region.m_atlas, Instance{ {}, {}, region.m_uv, sprite->m_colour } });
+		m_inputs.push(transform->m_position, transform->m_scale, region.m_size);
+	}
+	m_frameStats.m_sprites = (int)m_queued.size();
+
+	ResourcePtr<ThreadPool> pool;
+	QueuedSprite* queued = m_queued.data();
+	pool->parallelFor(m_queued.size(), s_generateChunk, [this, queued](std::size_t first, std::size_t count) {
+		generateInstances(m_inputs, first, count, queued);
+	});
+
+	// slots whose contents moved or changed since last frame, the per frame buffers catch up from these
+	m_update++;
+	m_previousInstances.swap(m_instances);
+	m_instances.resize(m_queued.size());
+	batch(m_queued, m_instances.data(), &m_batches);
+
+	m_slotChanged.resize(m_instances.size(), 0);
+	for (std::size_t i = 0; i < m_instances.size(); i++)
+	{
+		if (i >= m_previousInstances.size() || memcmp(&m_instances[i], &m_previousInstances[i], sizeof(Instance)) != 0)
+			m_slotChanged[i] = m_update;
+	}
+
+	upload();
+}
+
+void SpriteSystem::upload()
+{
+	// render() submits on RenderEvent, so the Units are only recorded by the next update's submitAll and
+	// fenced by the frame after this one. Going round one more buffer than there are frames in flight,
+	// the one written (or grown) here was last submitted frame count + 1 updates ago and that fence has been waited on
+	ResourcePtr<Rendering::Device> device;
+	m_instanceBuffers.resize(device->getFrameCount() + 1);
+	m_frame = m_update % m_instanceBuffers.size();
+	InstanceBuffer& target = m_instanceBuffers[m_frame];
+
+	std::size_t size = m_instances.size() * sizeof(Instance);
+	if (!target.m_buffer)
+	{
+		target.m_buffer = std::make_shared<Rendering::Buffer>(Rendering::Buffer::Instance, Rendering::Buffer::Persistent, std::max(size, sizeof(Instance) * 1024));
+		target.m_buffer->setFormat({
+				{vk::Format::eR32G32B32Sfloat, sizeof(glm::vec3)},
+				{vk::Format::eR32G32Sfloat, sizeof(glm::vec2)},
+				{vk::Format::eR32G32B32A32Sfloat, sizeof(glm::vec4)},
+				{vk::Format::eR32G32B32A32Sfloat, sizeof(glm::vec4)},
+			}, sizeof(Instance));
+		target.m_written = 0;
+	}
+	else if (target.m_buffer->grow(size))
+		target.m_written = 0; // recreated empty
+
+	char* map = (char*)target.m_buffer->map();
+	std::size_t i = 0;
+	while (i < m_instances.size())
+	{
+		if (m_slotChanged[i] <= target.m_written)
+		{
+			i++;
+			continue;
+		}
+
+		std::size_t first = i;
+		while (i < m_instances.size() && m_slotChanged[i] > target.m_written)
+			i++;
+
+		std::size_t offset = first * sizeof(Instance), bytes = (i - first) * sizeof(Instance);
+		memcpy(map + offset, &m_instances[first], bytes);
+		target.m_buffer->flush(offset, bytes);
+		m_frameStats.m_uploadRanges++;
+		m_frameStats.m_uploadBytes += bytes;
+	}
+	target.m_buffer->unmap();
+	target.m_written = m_update;
+
+	for (const InstanceBuffer& buffer : m_instanceBuffers)
+		m_frameStats.m_bufferBytes += buffer.m_buffer ? buffer.m_buffer->getSize() : 0;
+}
 
-		map[0] = Vertex{ transform->m_position + glm::vec3{ halfWidth, -halfHeight, 0.0f }, { uv2.x, uv2.y } };
-		map[1] = Vertex{ transform->m_position + glm::vec3{ halfWidth, halfHeight, 0.0f }, { uv2.x, uv1.y } };
-		map[2] = Vertex{ transform->m_position + glm::vec3{ -halfWidth, -halfHeight, 0.0f }, { uv1.x, uv2.y } };
-		map[3] = Vertex{ transform->m_position + glm::vec3{ -halfWidth, halfHeight, 0.0f }, { uv1.x, uv1.y } };
+void SpriteSystem::InstanceInputs::clear()
+{
+	m_x.clear(); m_y.clear(); m_z.clear();
+	m_scaleX.clear(); m_scaleY.clear();
+	m_width.clear(); m_height.clear();
+}
 
-		/*debugManager->addLine3D(glm::vec4(map[0].m_position, 1), glm::vec4(map[1].m_position, 1), glm::vec4(0, 0, 0, 1));
-		debugManager->addLine3D(glm::vec4(map[1].m_position, 1), glm::vec4(map[3].m_position, 1), glm::vec4(0, 0, 0, 1));
-		debugManager->addLine3D(glm::vec4(map[2].m_position, 1), glm::vec4(map[3].m_position, 1), glm::vec4(0, 0, 0, 1));
-		debugManager->addLine3D(glm::vec4(map[2].m_position, 1), glm::vec4(map[0].m_position, 1), glm::vec4(0, 0, 0, 1));*/
+void SpriteSystem::InstanceInputs::push(const glm::vec3& position, const glm::vec3& scale, const glm::vec2& size)
+{
+	m_x.push_back(position.x); m_y.push_back(position.y); m_z.push_back(position.z);
+	m_scaleX.push_back(scale.x); m_scaleY.push_back(scale.y);
+	m_width.push_back(size.x); m_height.push_back(size.y);
+}
 
-		map += 4;
+void SpriteSystem::generateInstances(const InstanceInputs& in, std::size_t first, std::size_t count, QueuedSprite* sprites, bool simd)
+{
+	// x * 0.5f rounds exactly like x / 2.0f, so every path matches the scalar one bit for bit
+	std::size_t i = first, end = first + count;
+	if (simd)
+	{
+#ifdef __AVX__
+		const __m256 half8 = _mm256_set1_ps(0.5f);
+		for (; i + 8 <= end; i += 8)
+		{
+			alignas(32) float w[8], h[8];
+			_mm256_store_ps(w, _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(&in.m_width[i]), half8), _mm256_loadu_ps(&in.m_scaleX[i])));
+			_mm256_store_ps(h, _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(&in.m_height[i]), half8), _mm256_loadu_ps(&in.m_scaleY[i])));
+			for (std::size_t l = 0; l < 8; l++)
+			{
+				Instance& instance = sprites[i + l].m_instance;
+				instance.m_position = { in.m_x[i + l], in.m_y[i + l], in.m_z[i + l] };
+				instance.m_halfSize = { w[l], h[l] };
+			}
+		}
+#endif
+		const __m128 half4 = _mm_set1_ps(0.5f);
+		for (; i + 4 <= end; i += 4)
+		{
+			alignas(16) float w[4], h[4];
+			_mm_store_ps(w, _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(&in.m_width[i]), half4), _mm_loadu_ps(&in.m_scaleX[i])));
+			_mm_store_ps(h, _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(&in.m_height[i]), half4), _mm_loadu_ps(&in.m_scaleY[i])));
+			for (std::size_t l = 0; l < 4; l++)
+			{
+				Instance& instance = sprites[i + l].m_instance;
+				instance.m_position = { in.m_x[i + l], in.m_y[i + l], in.m_z[i + l] };
+				instance.m_halfSize = { w[l], h[l] };
+			}
+		}
 	}
 
-	m_vertexBuffer->unmap();
+	for (; i < end; i++)
+	{
+		Instance& instance = sprites[i].m_instance;
+		instance.m_position = { in.m_x[i], in.m_y[i], in.m_z[i] };
+		instance.m_halfSize = { (in.m_width[i] / 2.0f) * in.m_scaleX[i], (in.m_height[i] / 2.0f) * in.m_scaleY[i] };
+	}
+}
+
+void SpriteSystem::batch(const std::vector<QueuedSprite>& sprites, Instance* instances, std::vector<Batch>* batches)
+{
+	// counting sort on the atlas, batches are in the order their atlas first shows up
+	batches->clear();
+	std::vector<uint32_t> batchOf(sprites.size());
+	std::vector<uint32_t> atlasBatch; // atlas indices are dense
+	for (std::size_t i = 0; i < sprites.size(); i++)
+	{
+		std::uint32_t atlas = sprites[i].m_atlas;
+		if (atlas >= atlasBatch.size())
+			atlasBatch.resize(atlas + 1, std::numeric_limits<uint32_t>::max());
+		if (atlasBatch[atlas] == std::numeric_limits<uint32_t>::max())
+		{
+			atlasBatch[atlas] = (uint32_t)batches->size();
+			batches->push_back(Batch{ atlas, 0, 0 });
+		}
+
+		(*batches)[atlasBatch[atlas]].m_instanceCount++;
+		batchOf[i] = atlasBatch[atlas];
+	}
+
+	uint32_t first = 0;
+	for (Batch& b : *batches)
+	{
+		b.m_firstInstance = first;
+		first += b.m_instanceCount;
+	}
+
+	std::vector<uint32_t> next(batches->size());
+	for (std::size_t b = 0; b < batches->size(); b++)
+		next[b] = (*batches)[b].m_firstInstance;
+
+	for (std::size_t i = 0; i < sprites.size(); i++)
+		instances[next[batchOf[i]]++] = sprites[i].m_instance;
 }
 
 void SpriteSystem::render(const RenderEvent& e)
 {
-	if (!ready(nullptr, m_vertexShader, m_fragmentShader))
+	m_frameStats.m_units = m_frameStats.m_draws = 0;
+	if (!ready(nullptr, m_vertexShader, m_fragmentShader) || m_instanceBuffers.empty() || !m_instanceBuffers[m_frame].m_buffer)
 		return;
 
-	ResourcePtr<SpriteManager> spriteManager;
-	EntityIterator<SpriteComponent> it(true);
-
 	ResourcePtr<Rendering::Device> device;
-
-	int i = 0;
-	while (it.next())
+	ResourcePtr<SpriteManager> spriteManager;
+	const std::vector<Rendering::TextureAtlas*>& atlases = spriteManager->getAtlasTable();
+	Rendering::Buffer* instances = m_instanceBuffers[m_frame].m_buffer.get();
+	for (const Batch& batch : m_batches)
 	{
-		auto sprite = it.get<SpriteComponent>();
-		std::tuple<SpriteData*, Rendering::TextureAtlas*> spriteData = spriteManager->getSpriteData(sprite->m_sprite);
-		ResourcePtr<Rendering::Texture> texture(NoOwnershipPtr, std::get<1>(spriteData));
-		if (!std::get<1>(spriteData))
-			continue; // still loading
+		ResourcePtr<Rendering::Texture> texture(NoOwnershipPtr, atlases[batch.m_atlas]);
 
 		Rendering::Unit unit(device->getRootUnit());
-		unit.in(&(*m_vertexBuffer));
-		unit.in(&(*m_indexBuffer));
+		unit.in(m_quadBuffer.get());
+		unit.in(instances);
 		unit.in(m_vertexShader);
 		unit.in(m_fragmentShader);
 		unit.in(std::array<float, 4>{ m_clearColour.x, m_clearColour.y, m_clearColour.z, m_clearColour.w, });
@@ -171,14 +414,38 @@ void SpriteSystem::render(const RenderEvent& e)
 		memcpy(&pushData[0], &e.m_projection, sizeof(glm::mat4));
 		unit.in({ vk::ShaderStageFlagBits::eVertex, std::move(pushData) });
 		unit.in({ vk::ShaderStageFlagBits::eFragment, 0, texture });
-		unit.in(Rendering::Unit::Draw{ 4, 1, (uint32_t)i++ * 4, 0 });
+		unit.in(Rendering::Unit::Draw{ 4, batch.m_instanceCount, 0, batch.m_firstInstance });
 		unit.submit();
+
+		m_frameStats.m_units++;
+		m_frameStats.m_draws++;
 	}
 }
 
+SpriteSystem::FrameStats SpriteSystem::getFrameStats() const
+{
+	return m_frameStats;
+}
+
 void SpriteSystem::imgui()
 {
+	ResourcePtr<ImGuiManager> im;
+	bool* opened = im->win("Sprites");
+	if (*opened == false)
+		return;
 
+	using namespace ImGui;
+	if (Begin("Sprites", opened))
+	{
+		Text("Sprites: %d", m_frameStats.m_sprites);
+		Text("Clocks: %d (%d changed frame)", m_frameStats.m_clocks, m_frameStats.m_resampled);
+		Text("Units: %d Draws: %d", m_frameStats.m_units, m_frameStats.m_draws);
+		Text("Uploaded: %s in %d ranges", prettySize(m_frameStats.m_uploadBytes).c_str(), m_frameStats.m_uploadRanges);
+		Text("Instance buffers: %d, %s", (int)m_instanceBuffers.size(), prettySize(m_frameStats.m_bufferBytes).c_str());
+		for (const Batch& batch : m_batches)
+			Text("Atlas %u: %u instances from %u", batch.m_atlas, batch.m_instanceCount, batch.m_firstInstance);
+	}
+	End();
 }
 
 SpriteComponent* SpriteSystem::addComponent(Entity e, StringView spritePath)
@@ -187,7 +454,6 @@ SpriteComponent* SpriteSystem::addComponent(Entity e, StringView spritePath)
 	ResourcePtr<ComponentManager> components;
 	SpriteComponent* sprite = components->addComponents<SpriteComponent>(e).get<SpriteComponent>();
 	sprite->m_sprite = spriteManager->getSprite(spritePath);
-	sprite->m_time = 0.0f;
 	return sprite;
 }
 
@@ -197,7 +463,6 @@ SpriteComponent* SpriteSystem::addComponent(Entity e, ResourcePtr<Rendering::Tex
 	ResourcePtr<ComponentManager> components;
 	SpriteComponent* sprite = components->addComponents<SpriteComponent>(e).get<SpriteComponent>();
 	sprite->m_sprite = spriteManager->getSprite(texture);
-	sprite->m_time = 0.0f;
 	return sprite;
 }
 
@@ -227,6 +492,115 @@ void SpriteSystem::test(std::function<void(float)>& update, std::function<void()
 	camera.get<CameraComponent>()->m_controlType = CameraComponent::WASD;
 }
 
+void SpriteSystem::benchmark()
+{
+	using namespace std::chrono;
+	const int atlasCount = 16;
+	for (int count : { 10000, 50000, 100000 })
+	{
+		// atlas indices are only compared, no SpriteManager needed
+		std::vector<QueuedSprite> sprites(count);
+		for (int i = 0; i < count; i++)
+		{
+			sprites[i].m_atlas = (std::uint32_t)((i * 7) % atlasCount);
+			sprites[i].m_instance = Instance{ glm::vec3((float)i, 0.0f, 0.0f), glm::vec2(8.0f), glm::vec4(0.0f, 0.0f, 1.0f, 1.0f), glm::vec4(1.0f) };
+		}
+
+		std::vector<Instance> instances(count);
+		std::vector<Batch> batches;
+		auto start = high_resolution_clock::now();
+		batch(sprites, instances.data(), &batches);
+		float ms = duration<float, std::milli>(high_resolution_clock::now() - start).count();
+
+		uint32_t total = 0;
+		for (const Batch& b : batches)
+		{
+			CHECK_F(b.m_firstInstance == total);
+			total += b.m_instanceCount;
+			for (uint32_t i = 1; i < b.m_instanceCount; i++) // stable within an atlas
+				CHECK_F(instances[b.m_firstInstance + i - 1].m_position.x < instances[b.m_firstInstance + i].m_position.x);
+		}
+		CHECK_F(total == (uint32_t)count);
+		CHECK_F(batches.size() == atlasCount);
+
+		LOG_F(INFO, "%d sprites: %d batches, batch() %.3fms\n", count, (int)batches.size(), ms);
+	}
+}
+
+void SpriteSystem::benchmarkFrames(std::function<void(float)>& update, std::function<void()>& render)
+{
+	ResourcePtr<ComponentManager> components;
+	ResourcePtr<SpriteManager> spriteManager;
+
+	const int spriteCount = 10000;
+	const char* paths[] = { "TestGif.gif", "doge.png", "garbage.png" }; // an atlas each
+	for (int i = 0; i < spriteCount; i++)
+	{
+		auto entity = components->addEntity<TransformComponent, SpriteComponent>();
+		entity.get<SpriteComponent>()->m_sprite = spriteManager->getSprite(paths[i % countof(paths)]);
+		entity.get<TransformComponent>()->m_position = glm::vec3((i % 100) * 10.0f, (i / 100) * 10.0f, 0.0f);
+	}
+
+	auto camera = components->addEntity<TransformComponent, CameraComponent>();
+	camera.get<TransformComponent>()->m_position = glm::vec3(500.0f, 500.0f, -1000.0f);
+	camera.get<CameraComponent>()->m_controlType = CameraComponent::WASD;
+
+	// after render(), the counts are what it submitted this frame. Once a second, the sprites take a while to load
+	std::shared_ptr<float> elapsed = std::make_shared<float>(0.0f);
+	ResourcePtr<EventManager> events;
+	events->addListener<RenderEvent>([elapsed](RenderEvent* e) {
+		*elapsed += e->m_delta;
+		if (*elapsed < 1.0f)
+			return;
+
+		*elapsed = 0.0f;
+		ResourcePtr<SpriteSystem> sprites;
+		FrameStats stats = sprites->getFrameStats();
+		LOG_F(INFO, "%d sprites drawn with %d units/%d draws, %d clocks\n", stats.m_sprites, stats.m_units, stats.m_draws, stats.m_clocks);
+	}, -1);
+}
+
+void SpriteSystem::testGeneration()
+{
+	// odd count so the simd loops leave a scalar tail, sizes and scales that don't round nicely
+	const std::size_t count = 3 * s_generateChunk + 13;
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-10000.0f, 10000.0f), scale(-4.0f, 4.0f), size(0.0f, 2048.0f);
+	InstanceInputs inputs;
+	for (std::size_t i = 0; i < count; i++)
+	{
+		glm::vec2 frameSize(i % 3 == 0 ? std::floor(size(random)) : size(random), size(random));
+		inputs.push({ position(random), position(random), position(random) }, { scale(random), scale(random), 1.0f }, frameSize);
+	}
+	inputs.m_scaleX[1] = 1e-40f; // denormals
+	inputs.m_width[2] = std::numeric_limits<float>::min();
+
+	std::vector<QueuedSprite> scalar(count), simd(count), chunked(count);
+	generateInstances(inputs, 0, count, scalar.data(), false);
+	generateInstances(inputs, 0, count, simd.data(), true);
+
+	ResourcePtr<ThreadPool> pool;
+	QueuedSprite* chunkedData = chunked.data();
+	pool->parallelFor(count, s_generateChunk, [&inputs, chunkedData](std::size_t first, std::size_t n) { generateInstances(inputs, first, n, chunkedData); });
+
+	int mismatches = 0;
+	for (std::size_t i = 0; i < count; i++)
+	{
+		const Instance& s = scalar[i].m_instance;
+		if (memcmp(&s.m_position, &simd[i].m_instance.m_position, sizeof(glm::vec3) + sizeof(glm::vec2)) != 0 ||
+			memcmp(&s.m_position, &chunked[i].m_instance.m_position, sizeof(glm::vec3) + sizeof(glm::vec2)) != 0)
+			mismatches++;
+	}
+	CHECK_F(mismatches == 0, "%d of %d sprites differ from the scalar path", mismatches, (int)count);
+
+#ifdef __AVX__
+	const char* path = "AVX";
+#else
+	const char* path = "SSE";
+#endif
+	LOG_F(INFO, "generateInstances: %s and %d chunks match the scalar path on %d sprites\n", path, (int)((count + s_generateChunk - 1) / s_generateChunk), (int)count);
+}
+
 glm::vec4 SpriteSystem::m_clearColour(0.45f, 0.55f, 0.6f, 1.0f);
 
 template<> Meta::Object Meta::instanceMeta<SpriteSystem>()
@@ -238,5 +612,7 @@ template<> Meta::Object Meta::instanceMeta<SpriteSystem>()
 template<> Meta::Object Meta::instanceMeta<SpriteComponent>()
 {
 	return Object("SpriteComponent").
-		var("m_sprite", &SpriteComponent::m_sprite);
+		var("m_sprite", &SpriteComponent::m_sprite).
+		var("m_clockGroup", &SpriteComponent::m_clockGroup).
+		var("m_colour", &SpriteComponent::m_colour);
 }
\ No newline at end of file
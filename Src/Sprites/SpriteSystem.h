@@ -15,8 +15,11 @@ namespace Rendering
 struct SpriteComponent : public Component<SpriteComponent>
 {
 	SpriteId m_sprite;
-	float m_time;
+	int m_clockGroup{ 0 }; // sprites with the same m_sprite and group animate in step
 	glm::vec3 m_scale;
+	glm::vec4 m_colour{ 1.0f };
+
+	int m_clock{ -1 }; // SpriteSystem's clock for m_sprite and m_clockGroup, looked up again when either changes
 };
 
 struct RenderEvent;
@@ -38,17 +41,117 @@ public:
 	struct Vertex { glm::vec3 m_position; glm::vec2 m_uv; };
 	bool getVertices(std::array<Vertex, 4>* vertices, SpriteComponent*, TransformComponent*) const;
 
+	// per sprite data of the instanced draws, the quad itself is shared
+	struct Instance
+	{
+		glm::vec3 m_position; // z is the layer
+		glm::vec2 m_halfSize;
+		glm::vec4 m_uv; // top left xy, bottom right zw
+		glm::vec4 m_colour;
+	};
+
+	// one per sprite and group, advanced once a frame no matter how many sprites play it.
+	// Only samples the SpriteData when its frame runs out
+	struct Clock
+	{
+		SpriteId m_sprite;
+		int m_group;
+		float m_time{ 0.0f }; // kept inside the animation's loop
+		float m_speed{ 1.0f };
+		float m_frameStart{ 0.0f }, m_frameEnd{ -1.0f }; // of the sampled frame
+		unsigned int m_atlasGeneration{ 0 };
+		int m_region{ -1 }; // SpriteManager::getRegions() of the frame, -1 while loading
+	};
+
+	int getClock(SpriteId, int group = 0); // creates it
+	void setClockSpeed(SpriteId, int group, float speed);
+	void resetClock(SpriteId, int group); // back to the first frame
+	void advanceClocks(float delta);
+
+	struct QueuedSprite
+	{
+		std::uint32_t m_atlas; // SpriteManager::getAtlasTable() index
+		Instance m_instance;
+	};
+
+	// one Unit and one draw
+	struct Batch
+	{
+		std::uint32_t m_atlas;
+		uint32_t m_firstInstance;
+		uint32_t m_instanceCount;
+	};
+
+	struct FrameStats
+	{
+		int m_sprites{ 0 };
+		int m_clocks{ 0 };
+		int m_resampled{ 0 }; // clocks that moved to another frame
+		int m_units{ 0 };
+		int m_draws{ 0 };
+		int m_uploadRanges{ 0 };
+		std::size_t m_uploadBytes{ 0 };
+		std::size_t m_bufferBytes{ 0 }; // all frames in flight
+	};
+
+	// transform inputs of generateInstances, one entry per queued sprite
+	struct InstanceInputs
+	{
+		std::vector<float> m_x, m_y, m_z;
+		std::vector<float> m_scaleX, m_scaleY;
+		std::vector<float> m_width, m_height; // of the current frame
+
+		void clear();
+		void push(const glm::vec3& position, const glm::vec3& scale, const glm::vec2& size);
+		std::size_t size() const { return m_x.size(); }
+	};
+
+	// fills in position and half size of sprites[first, first + count), 8 (AVX) or 4 (SSE) at a time unless simd is false
+	static void generateInstances(const InstanceInputs&, std::size_t first, std::size_t count, QueuedSprite* sprites, bool simd = true);
+
+	// groups the sprites by atlas into instances (sprites.size() of them), keeps their order within an atlas
+	static void batch(const std::vector<QueuedSprite>& sprites, Instance* instances, std::vector<Batch>* batches);
+	FrameStats getFrameStats() const;
+
 	static void test(std::function<void(float)>& update, std::function<void()>& render);
+	static void benchmark(); // headless, batch() on 10k, 50k and 100k sprites
+	static void benchmarkFrames(std::function<void(float)>& update, std::function<void()>& render); // 10k sprites over three atlases, logs the units and draws render() submits
+	static void testGeneration(); // headless, simd and chunked generateInstances against the scalar path, bit for bit
 
 	static glm::vec4 m_clearColour;
 
+protected:
+	void upload();
+	const Clock* findClock(SpriteComponent*);
+	void sampleClock(Clock&); // looks up its frame and region for m_time
+
 protected:
 	ResourcePtr<ComponentManager> m_components;
 	std::vector<ResourcePtr<SpriteData>> m_spriteData;
 	std::vector<Rendering::TextureAtlas> m_textures;
 
 	ResourcePtr<Rendering::Shader> m_vertexShader, m_fragmentShader;
-	std::shared_ptr<Rendering::Buffer> m_vertexBuffer, m_indexBuffer;
+	std::shared_ptr<Rendering::Buffer> m_quadBuffer;
+
+	// persistently mapped instance buffers, one per frame in flight plus one (see upload()). Each only gets the slots that changed since it was last written
+	struct InstanceBuffer
+	{
+		std::shared_ptr<Rendering::Buffer> m_buffer;
+		unsigned int m_written{ 0 }; // m_update it's up to date with, 0 is never
+	};
+	std::vector<InstanceBuffer> m_instanceBuffers;
+	std::size_t m_frame{ 0 };
+
+	std::vector<QueuedSprite> m_queued; // reused every frame
+	InstanceInputs m_inputs;
+
+	std::vector<Clock> m_clocks;
+	std::map<std::tuple<SpriteId, int>, int> m_clockIds;
+	std::vector<Batch> m_batches;
+	std::vector<Instance> m_instances, m_previousInstances; // batched, what the buffers should hold
+	std::vector<unsigned int> m_slotChanged; // m_update each instance slot last changed in
+	unsigned int m_update{ 0 };
+	FrameStats m_frameStats;
 };
 
 namespace Meta {
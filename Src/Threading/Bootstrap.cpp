@@ -0,0 +1,190 @@
+#include "stdafx.h"
+#include "Bootstrap.h"
+#include "ThreadPool.h"
+#include "../imgui/ImGuiManager.h"
+
+Bootstrap::Bootstrap():
+m_totalMs(0.0f),
+m_finished(0),
+m_pool(nullptr)
+{
+
+}
+
+void Bootstrap::add(const char* name, std::vector<const char*> dependencies, std::function<void()> init, int flags)
+{
+	Step step;
+	step.m_name = name;
+	step.m_dependencies = std::move(dependencies);
+	step.m_init = std::move(init);
+	step.m_flags = flags;
+	step.m_pendingDependencies = 0;
+	step.m_startMs = step.m_endMs = 0.0f;
+	step.m_thread = -1;
+	m_steps.push_back(std::move(step));
+}
+
+void Bootstrap::run()
+{
+	std::map<std::string, std::size_t> indices;
+	for (std::size_t i = 0; i < m_steps.size(); i++)
+		indices[m_steps[i].m_name] = i;
+
+	for (std::size_t i = 0; i < m_steps.size(); i++)
+	{
+		Step& step = m_steps[i];
+		step.m_pendingDependencies = (int)step.m_dependencies.size();
+		for (const char* dependency : step.m_dependencies)
+		{
+			auto it = indices.find(dependency);
+			CHECK_F(it != indices.end(), "Bootstrap step \"%s\" depends on unknown step \"%s\"", step.m_name.c_str(), dependency);
+			m_steps[it->second].m_dependents.push_back(i);
+		}
+	}
+
+	// make sure it can finish before handing out work
+	{
+		std::vector<int> pending(m_steps.size());
+		std::vector<std::size_t> ready;
+		for (std::size_t i = 0; i < m_steps.size(); i++)
+		{
+			pending[i] = m_steps[i].m_pendingDependencies;
+			if (pending[i] == 0)
+				ready.push_back(i);
+		}
+
+		std::size_t visited = 0;
+		while (!ready.empty())
+		{
+			std::size_t i = ready.back();
+			ready.pop_back();
+			visited++;
+			for (std::size_t dependent : m_steps[i].m_dependents)
+			{
+				if (--pending[dependent] == 0)
+					ready.push_back(dependent);
+			}
+		}
+		CHECK_F(visited == m_steps.size(), "Bootstrap steps have a dependency cycle");
+	}
+
+	ResourcePtr<ThreadPool> pool;
+	m_pool = pool->getThreadCount() > 0 ? pool.get() : nullptr;
+	m_start = std::chrono::high_resolution_clock::now();
+
+	std::unique_lock<std::mutex> l(m_mutex);
+	m_finished = 0;
+	m_threads = { std::this_thread::get_id() };
+	for (std::size_t i = 0; i < m_steps.size(); i++)
+	{
+		if (m_steps[i].m_pendingDependencies == 0)
+			schedule(i);
+	}
+
+	while (m_finished < m_steps.size())
+	{
+		if (!m_readyMain.empty())
+		{
+			std::size_t index = m_readyMain.front();
+			m_readyMain.erase(m_readyMain.begin());
+
+			l.unlock();
+			runStep(index);
+			l.lock();
+			continue;
+		}
+
+		m_condition.wait(l);
+	}
+
+	m_pool = nullptr;
+	m_totalMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - m_start).count();
+}
+
+void Bootstrap::schedule(std::size_t index)
+{
+	// m_mutex must be locked
+	if ((m_steps[index].m_flags & MainThread) || !m_pool)
+		m_readyMain.push_back(index);
+	else
+		m_pool->enqueue([this, index]() { runStep(index); });
+}
+
+void Bootstrap::runStep(std::size_t index)
+{
+	using namespace std::chrono;
+	Step& step = m_steps[index];
+
+	float startMs = duration<float, std::milli>(high_resolution_clock::now() - m_start).count();
+	step.m_init();
+	float endMs = duration<float, std::milli>(high_resolution_clock::now() - m_start).count();
+
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		step.m_startMs = startMs;
+		step.m_endMs = endMs;
+
+		auto thread = std::find(m_threads.begin(), m_threads.end(), std::this_thread::get_id());
+		step.m_thread = (int)(thread - m_threads.begin());
+		if (thread == m_threads.end())
+			m_threads.push_back(std::this_thread::get_id());
+
+		m_finished++;
+		for (std::size_t dependent : step.m_dependents)
+		{
+			if (--m_steps[dependent].m_pendingDependencies == 0)
+				schedule(dependent);
+		}
+	}
+	m_condition.notify_all();
+}
+
+void Bootstrap::report() const
+{
+	std::vector<const Step*> steps;
+	float serialMs = 0.0f;
+	for (const Step& step : m_steps)
+	{
+		steps.push_back(&step);
+		serialMs += step.m_endMs - step.m_startMs;
+	}
+	std::sort(steps.begin(), steps.end(), [](const Step* s1, const Step* s2) { return s1->m_startMs < s2->m_startMs; });
+
+	LOG_F(INFO, "Bootstrap took %.1fms (%.1fms if run one after another) on %d threads\n", m_totalMs, serialMs, (int)m_threads.size());
+	for (const Step* step : steps)
+		LOG_F(INFO, "  %-20s %8.1fms - %8.1fms (%6.1fms) thread %d\n", step->m_name.c_str(), step->m_startMs, step->m_endMs, step->m_endMs - step->m_startMs, step->m_thread);
+}
+
+void Bootstrap::imgui()
+{
+	ResourcePtr<ImGuiManager> im;
+	bool* opened = im->win("Bootstrap");
+	if (*opened == false)
+		return;
+
+	using namespace ImGui;
+	if (Begin("Bootstrap", opened))
+	{
+		Text("%d steps in %.1fms on %d threads", (int)m_steps.size(), m_totalMs, (int)m_threads.size());
+		Separator();
+
+		float nameWidth = 160.0f;
+		float width = std::max(GetContentRegionAvail().x - nameWidth, 1.0f);
+		float scale = m_totalMs > 0.0f ? width / m_totalMs : 0.0f;
+		for (const Step& step : m_steps)
+		{
+			Text("%s", step.m_name.c_str());
+			SameLine(nameWidth);
+
+			// one colour per thread
+			ImVec2 pos = GetCursorScreenPos();
+			float height = GetTextLineHeight();
+			ImU32 colour = ImColor::HSV((step.m_thread * 0.17f) - (int)(step.m_thread * 0.17f), 0.6f, 0.8f);
+			GetWindowDrawList()->AddRectFilled(ImVec2(pos.x + step.m_startMs * scale, pos.y), ImVec2(pos.x + std::max(step.m_endMs * scale, step.m_startMs * scale + 1.0f), pos.y + height), colour);
+			Dummy(ImVec2(width, height));
+			if (IsItemHovered())
+				SetTooltip("%s\n%.1fms - %.1fms (%.1fms)\nthread %d", step.m_name.c_str(), step.m_startMs, step.m_endMs, step.m_endMs - step.m_startMs, step.m_thread);
+		}
+	}
+	End();
+}
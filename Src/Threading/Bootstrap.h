@@ -0,0 +1,62 @@
+#pragma once
+
+#include "../Resources/ResourceManager.h"
+
+class ThreadPool;
+
+// startup steps with declared dependencies, independent steps run concurrently on the ThreadPool
+class Bootstrap
+{
+public:
+	enum Flags
+	{
+		Any = 0,
+		MainThread = 1 // window, device and anything else that has to stay on the thread that runs the app
+	};
+
+public:
+	Bootstrap();
+
+	void add(const char* name, std::vector<const char*> dependencies, std::function<void()> init, int flags = Any);
+	template<typename T> void addSingleton(const char* name, std::vector<const char*> dependencies, int flags = Any);
+
+	void run(); // returns once every step finished
+	void report() const; // logs the timeline
+	void imgui();
+
+protected:
+	struct Step
+	{
+		std::string m_name;
+		std::vector<std::size_t> m_dependents;
+		std::vector<const char*> m_dependencies;
+		std::function<void()> m_init;
+		int m_flags;
+		int m_pendingDependencies;
+
+		float m_startMs, m_endMs;
+		int m_thread; // 0 is the main thread
+	};
+
+	void schedule(std::size_t index);
+	void runStep(std::size_t index);
+
+protected:
+	std::vector<Step> m_steps;
+	std::chrono::high_resolution_clock::time_point m_start;
+	float m_totalMs;
+
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::vector<std::size_t> m_readyMain;
+	std::size_t m_finished;
+	std::vector<std::thread::id> m_threads;
+	ThreadPool* m_pool; // null while not running, or when the pool has no threads
+};
+
+// ----------------------- IMPLEMENTATION -----------------------
+template<typename T>
+void Bootstrap::addSingleton(const char* name, std::vector<const char*> dependencies, int flags)
+{
+	add(name, std::move(dependencies), []() { ResourcePtr<T> singleton; }, flags);
+}
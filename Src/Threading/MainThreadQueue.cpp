@@ -0,0 +1,160 @@
+#include "stdafx.h"
+#include "MainThreadQueue.h"
+#include "../Managers/EventManager.h"
+#include "../imgui/ImGuiManager.h"
+
+static const char* s_priorityNames[] = { "Immediate", "High", "Normal", "Background" };
+static_assert(sizeof(s_priorityNames) / sizeof(s_priorityNames[0]) == (std::size_t)MainThreadQueue::Priority::Count, "");
+
+MainThreadQueue::MainThreadQueue()
+{
+	setBudget(Priority::High, 4.0f);
+	setBudget(Priority::Normal, 2.0f);
+	setBudget(Priority::Background, 1.0f);
+
+	// after everything else on UpdateEvent, so work posted this frame starts right away
+	ResourcePtr<EventManager> events;
+	events->addListener<UpdateEvent>([this](UpdateEvent*) { run(); }, -10);
+}
+
+void MainThreadQueue::post(Priority priority, std::function<void()> function, const char* name)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	m_queues[(std::size_t)priority].push_back({ std::move(function), name, m_stats.m_frames });
+
+	ClassStats& stats = m_stats.m_classes[(std::size_t)priority];
+	stats.m_queued++;
+	stats.m_peakQueued = std::max(stats.m_peakQueued, stats.m_queued);
+}
+
+void MainThreadQueue::setBudget(Priority priority, float ms)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	m_stats.m_classes[(std::size_t)priority].m_budgetMs = ms;
+}
+
+void MainThreadQueue::run()
+{
+	using namespace std::chrono;
+	float frameMs = 0.0f;
+	unsigned int frame;
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		frame = ++m_stats.m_frames;
+	}
+
+	for (std::size_t c = 0; c < (std::size_t)Priority::Count; c++)
+	{
+		bool unlimited = (Priority)c == Priority::Immediate;
+		std::size_t count;
+		duration<float, std::milli> budget;
+		{
+			// items posted by the handlers below wait for the next frame, or a handler that requeues itself would never stop
+			std::lock_guard<std::mutex> l(m_mutex);
+			count = m_queues[c].size();
+			budget = duration<float, std::milli>(m_stats.m_classes[c].m_budgetMs);
+		}
+
+		auto start = high_resolution_clock::now();
+		for (std::size_t i = 0; i < count; i++)
+		{
+			// always run one so a tiny budget still makes progress
+			if (!unlimited && i > 0 && high_resolution_clock::now() - start >= budget)
+				break;
+
+			Item item;
+			{
+				std::lock_guard<std::mutex> l(m_mutex);
+				item = std::move(m_queues[c].front());
+				m_queues[c].pop_front();
+			}
+
+			auto itemStart = high_resolution_clock::now();
+			item.m_function();
+			float ms = duration<float, std::milli>(high_resolution_clock::now() - itemStart).count();
+
+			std::lock_guard<std::mutex> l(m_mutex);
+			ClassStats& stats = m_stats.m_classes[c];
+			stats.m_queued--;
+			stats.m_run++;
+			stats.m_maxWaitFrames = std::max(stats.m_maxWaitFrames, frame - item.m_frame);
+			if (ms > stats.m_slowestMs)
+			{
+				stats.m_slowestMs = ms;
+				stats.m_slowest = item.m_name;
+			}
+		}
+
+		float spent = duration<float, std::milli>(high_resolution_clock::now() - start).count();
+		frameMs += spent;
+
+		std::lock_guard<std::mutex> l(m_mutex);
+		ClassStats& stats = m_stats.m_classes[c];
+		stats.m_lastMs = spent;
+		stats.m_deferred += (int)m_queues[c].size();
+		if (!unlimited && spent > stats.m_budgetMs)
+			stats.m_overruns++;
+	}
+
+	m_history[m_historyIndex] = frameMs;
+	m_historyIndex = (m_historyIndex + 1) % HistorySize;
+}
+
+MainThreadQueue::Stats MainThreadQueue::getStats() const
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	return m_stats;
+}
+
+void MainThreadQueue::imgui()
+{
+	ResourcePtr<ImGuiManager> im;
+	bool* opened = im->win("Main Thread Queue");
+	if (*opened == false)
+		return;
+
+	using namespace ImGui;
+	if (Begin("Main Thread Queue", opened))
+	{
+		Stats stats = getStats();
+		PlotLines("ms per frame", m_history.data(), HistorySize, m_historyIndex, nullptr, 0.0f, FLT_MAX, ImVec2(0, 60));
+
+		Columns(9);
+		Separator();
+		Text("Priority"); NextColumn();
+		Text("Budget (ms)"); NextColumn();
+		Text("Queued (peak)"); NextColumn();
+		Text("Run"); NextColumn();
+		Text("Deferred"); NextColumn();
+		Text("Overruns"); NextColumn();
+		Text("Max wait"); NextColumn();
+		Text("Last frame"); NextColumn();
+		Text("Slowest"); NextColumn();
+		Separator();
+		for (std::size_t c = 0; c < (std::size_t)Priority::Count; c++)
+		{
+			ClassStats& s = stats.m_classes[c];
+			Text("%s", s_priorityNames[c]); NextColumn();
+			if ((Priority)c == Priority::Immediate)
+				Text("-");
+			else
+			{
+				PushID((int)c);
+				if (DragFloat("##budget", &s.m_budgetMs, 0.1f, 0.0f, 100.0f, "%.1f"))
+					setBudget((Priority)c, s.m_budgetMs);
+				PopID();
+			}
+			NextColumn();
+			Text("%d (%d)", s.m_queued, s.m_peakQueued); NextColumn();
+			Text("%d", s.m_run); NextColumn();
+			Text("%d", s.m_deferred); NextColumn();
+			Text("%d", s.m_overruns); NextColumn();
+			Text("%u frames", s.m_maxWaitFrames); NextColumn();
+			Text("%.2fms", s.m_lastMs); NextColumn();
+			Text("%.2fms %s", s.m_slowestMs, s.m_slowest); NextColumn();
+		}
+		Separator();
+		Columns(1);
+	}
+	End();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "../Resources/ResourceManager.h"
+
+// main thread follow-ups of finished loads (atlas layouts, uploads).
+// Each priority class gets a few milliseconds a frame, a burst of loads is spread over several frames instead of hitching one
+class MainThreadQueue : public SingletonResource<MainThreadQueue>
+{
+public:
+	enum class Priority
+	{
+		Immediate, // always run on the next update, no budget
+		High,
+		Normal,
+		Background,
+		Count
+	};
+
+	struct ClassStats
+	{
+		float m_budgetMs{ 0.0f };
+		int m_queued{ 0 };
+		int m_peakQueued{ 0 };
+		int m_run{ 0 };
+		int m_deferred{ 0 }; // +1 for every item still waiting at the end of a frame
+		int m_overruns{ 0 }; // frames that went past the budget
+		unsigned int m_maxWaitFrames{ 0 };
+		float m_lastMs{ 0.0f };
+		float m_slowestMs{ 0.0f };
+		const char* m_slowest{ "" };
+	};
+
+	struct Stats
+	{
+		std::array<ClassStats, (std::size_t)Priority::Count> m_classes;
+		unsigned int m_frames{ 0 };
+	};
+
+public:
+	MainThreadQueue();
+
+	// thread safe, runs on a later update. name has to outlive the queue (a literal)
+	void post(Priority, std::function<void()>, const char* name = "");
+
+	void setBudget(Priority, float ms); // at least one item still runs per frame
+	void run(); // once a frame on UpdateEvent
+
+	Stats getStats() const;
+	void imgui();
+
+protected:
+	struct Item
+	{
+		std::function<void()> m_function;
+		const char* m_name;
+		unsigned int m_frame;
+	};
+
+protected:
+	mutable std::mutex m_mutex;
+	std::array<std::deque<Item>, (std::size_t)Priority::Count> m_queues;
+	Stats m_stats;
+
+	static const int HistorySize = 120;
+	std::array<float, HistorySize> m_history{}; // total ms per frame, main thread only
+	int m_historyIndex{ 0 };
+};
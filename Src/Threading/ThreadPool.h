@@ -14,6 +14,11 @@ public:
 	template<class F, class... Args>
 	auto enqueue(F&& f, Args&&... args)->std::future< typename std::result_of<F(Args...)>::type >;
 
+	// f(first, count) over [0, count) in chunks of grain, on the pool and the calling thread.
+	// Returns when every chunk is done, workers still busy with other tasks just take fewer chunks
+	template<class F>
+	void parallelFor(std::size_t count, std::size_t grain, F&& f);
+
 protected:
 	std::vector< std::thread > m_workers;
 	std::queue< std::function<void()> > m_tasks;
@@ -46,4 +51,57 @@ auto ThreadPool::enqueue(F&& f, Args&&... args) -> std::future<typename std::res
 	}
 	m_condition.notify_one();
 	return res;
-}
\ No newline at end of file
+}
+
+template<class F>
+void ThreadPool::parallelFor(std::size_t count, std::size_t grain, F&& f)
+{
+	grain = std::max<std::size_t>(grain, 1);
+	std::size_t chunks = (count + grain - 1) / grain;
+	if (chunks <= 1 || m_threadCount == 0)
+	{
+		if (count > 0)
+			f(std::size_t(0), count);
+		return;
+	}
+
+	struct Job
+	{
+		std::atomic<std::size_t> m_next{ 0 };
+		std::atomic<std::size_t> m_done{ 0 };
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+	};
+	auto job = std::make_shared<Job>();
+
+	// f is only touched after claiming a chunk, a worker that starts after the caller returned finds none left
+	auto work = [job, chunks, count, grain, &f]()
+	{
+		std::size_t chunk;
+		while ((chunk = job->m_next++) < chunks)
+		{
+			std::size_t first = chunk * grain;
+			f(first, std::min(grain, count - first));
+			if (++job->m_done == chunks)
+			{
+				std::lock_guard<std::mutex> l(job->m_mutex);
+				job->m_condition.notify_all();
+			}
+		}
+	};
+
+	{
+		std::unique_lock<std::mutex> lock(m_queueMutex);
+		if (!m_stop)
+		{
+			for (std::size_t i = 0, helpers = std::min(chunks - 1, m_threadCount); i < helpers; i++)
+				m_tasks.emplace(work);
+		}
+	}
+	m_condition.notify_all();
+
+	work();
+
+	std::unique_lock<std::mutex> l(job->m_mutex);
+	job->m_condition.wait(l, [&job, chunks]() { return job->m_done == chunks; });
+}
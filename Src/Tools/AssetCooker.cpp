@@ -0,0 +1,187 @@
+#include "stdafx.h"
+#include "AssetCooker.h"
+#include "../Files/CookedAsset.h"
+#include "../Files/FileManager.h"
+#include "../Misc/Misc.h"
+
+static bool readFile(const std::string& path, std::vector<char>* contents)
+{
+	std::ifstream in(path, std::ios_base::binary);
+	if (!in.is_open())
+		return false;
+
+	contents->assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	return true;
+}
+
+AssetCooker::AssetCooker(StringView sourceDir, StringView cacheDir):
+m_sourceDir(sourceDir.str()),
+m_cacheDir(cacheDir.str())
+{
+
+}
+
+bool AssetCooker::cook(StringView archivePath, Stats* stats)
+{
+	std::vector<std::string> names;
+	listFiles("", &names);
+	std::sort(names.begin(), names.end());
+
+	std::vector<Archive::Source> sources;
+	for (const std::string& name : names)
+	{
+		std::string storedPath;
+		switch (cookFile(name, &storedPath))
+		{
+		case Result::Cooked: stats->m_cooked++; break;
+		case Result::UpToDate: stats->m_upToDate++; break;
+		case Result::Raw: stats->m_raw++; break;
+		case Result::Failed: stats->m_failed++; break;
+		}
+
+		WIN32_FILE_ATTRIBUTE_DATA source, stored;
+		if (GetFileAttributesExA((m_sourceDir + name).c_str(), GetFileExInfoStandard, &source))
+			stats->m_sourceBytes += ULARGE_INTEGER{ source.nFileSizeLow, source.nFileSizeHigh }.QuadPart;
+		if (GetFileAttributesExA(storedPath.c_str(), GetFileExInfoStandard, &stored))
+			stats->m_cookedBytes += ULARGE_INTEGER{ stored.nFileSizeLow, stored.nFileSizeHigh }.QuadPart;
+
+		sources.push_back({ name, storedPath });
+	}
+
+	return Archive::write(archivePath, sources, Archive::Compress);
+}
+
+AssetCooker::Result AssetCooker::cookFile(const std::string& name, std::string* storedPath)
+{
+	std::string sourcePath = m_sourceDir + name;
+	*storedPath = sourcePath;
+
+	std::string ext = FileManager::extension(name);
+	CookedAsset::Type type;
+	if (ext == "png")		type = CookedAsset::Type::Texture;
+	else if (ext == "gif")	type = CookedAsset::Type::Sprite;
+	else if (ext == "fbx")	type = CookedAsset::Type::Mesh;
+	else					return Result::Raw;
+
+	std::vector<char> source;
+	if (!readFile(sourcePath, &source))
+	{
+		LOG_F(ERROR, "Unable to read \"%s\"\n", sourcePath.c_str());
+		return Result::Failed;
+	}
+	StringView contents(source.data(), source.data() + source.size());
+
+	// the cached blob's header remembers which source it was cooked from
+	std::string cachePath = m_cacheDir + name;
+	{
+		std::ifstream cached(cachePath, std::ios_base::binary);
+		CookedAsset::Header header = {};
+		if (cached.read((char*)&header, sizeof(header)) && header.m_magic == CookedAsset::Magic && header.m_version == CookedAsset::Version &&
+			header.m_type == type && header.m_sourceHash == CookedAsset::hashSource(contents))
+		{
+			*storedPath = cachePath;
+			return Result::UpToDate;
+		}
+	}
+
+	std::vector<char> blob;
+	bool cooked = false;
+	switch (type)
+	{
+	case CookedAsset::Type::Texture: cooked = CookedAsset::cookTexture(contents, &blob); break;
+	case CookedAsset::Type::Sprite: cooked = CookedAsset::cookSprite(contents, &blob); break;
+	case CookedAsset::Type::Mesh: cooked = CookedAsset::cookMesh(contents, &blob); break;
+	}
+
+	if (!cooked)
+	{
+		LOG_F(WARNING, "Unable to cook \"%s\", packing the source instead\n", name.c_str());
+		return Result::Failed;
+	}
+
+	std::string tempPath = cachePath + ".tmp";
+	if (!createDirectories(cachePath))
+		return Result::Failed;
+
+	{
+		std::ofstream out(tempPath, std::ios_base::binary | std::ios_base::trunc);
+		out.write(blob.data(), blob.size());
+		if (!out.good())
+		{
+			LOG_F(ERROR, "Unable to write \"%s\"\n", tempPath.c_str());
+			return Result::Failed;
+		}
+	}
+
+	if (!MoveFileExA(tempPath.c_str(), cachePath.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		LOG_F(ERROR, "MoveFileEx failed \"%s\" (%X)\n", cachePath.c_str(), GetLastError());
+		return Result::Failed;
+	}
+
+	LOG_F(INFO, "Cooked \"%s\" (%s -> %s)\n", name.c_str(), prettySize(source.size()).c_str(), prettySize(blob.size()).c_str());
+	*storedPath = cachePath;
+	return Result::Cooked;
+}
+
+void AssetCooker::listFiles(const std::string& directory, std::vector<std::string>* names) const
+{
+	WIN32_FIND_DATAA findData;
+	HANDLE hFind = FindFirstFileA((m_sourceDir + directory + "*").c_str(), &findData);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return;
+
+	do
+	{
+		std::string name = findData.cFileName;
+		if (name == "." || name == "..")
+			continue;
+
+		if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			listFiles(directory + name + "/", names);
+		else if (!endsWith(name, ".jpak", 5) && !endsWith(name, ".tmp", 4))
+			names->push_back(directory + name);
+	} while (FindNextFileA(hFind, &findData));
+
+	FindClose(hFind);
+}
+
+bool AssetCooker::createDirectories(const std::string& path) const
+{
+	for (std::size_t slash = path.find('/'); slash != std::string::npos; slash = path.find('/', slash + 1))
+	{
+		std::string directory = path.substr(0, slash);
+		if (directory.empty() || directory == "." || directory == "..")
+			continue;
+
+		if (!CreateDirectoryA(directory.c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS)
+		{
+			LOG_F(ERROR, "CreateDirectoryA failed \"%s\" (%X)\n", directory.c_str(), GetLastError());
+			return false;
+		}
+	}
+	return true;
+}
+
+int AssetCooker::main(int argc, char** argv)
+{
+	// argv[0] is "--cook"
+	const char* sourceDir = argc > 1 ? argv[1] : "../Res/";
+	const char* cacheDir = argc > 2 ? argv[2] : "../Cooked/";
+	const char* archivePath = argc > 3 ? argv[3] : "../Res/assets.jpak";
+
+	auto directory = [](const char* path) {
+		std::string s = normalizePath(path);
+		return endsWith(s, "/", 1) ? s : s + "/";
+	};
+
+	auto start = std::chrono::high_resolution_clock::now();
+	AssetCooker cooker(directory(sourceDir), directory(cacheDir));
+	Stats stats;
+	bool success = cooker.cook(archivePath, &stats);
+	float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+
+	LOG_F(INFO, "Cooked %d, %d up to date, %d raw, %d failed in %.1fs. %s of sources, %s packed\n", stats.m_cooked, stats.m_upToDate, stats.m_raw, stats.m_failed, seconds,
+		prettySize(stats.m_sourceBytes).c_str(), prettySize(stats.m_cookedBytes).c_str());
+	return success ? 0 : 1;
+}
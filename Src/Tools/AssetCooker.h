@@ -0,0 +1,37 @@
+#pragma once
+
+#include "../Files/Archive.h"
+
+// decodes every asset under the source directory into GPU ready blobs (see CookedAsset) and packs them into an archive.
+// Run with "App.exe --cook [sourceDir] [cacheDir] [archive]", only sources whose contents changed are decoded again
+class AssetCooker
+{
+public:
+	struct Stats
+	{
+		int m_cooked = 0; // decoded this run
+		int m_upToDate = 0; // taken from the cache
+		int m_raw = 0; // packed as they are
+		int m_failed = 0; // packed as they are after failing to decode
+		std::size_t m_sourceBytes = 0;
+		std::size_t m_cookedBytes = 0;
+	};
+
+public:
+	AssetCooker(StringView sourceDir, StringView cacheDir);
+
+	bool cook(StringView archivePath, Stats* stats);
+
+	static int main(int argc, char** argv);
+
+protected:
+	enum class Result { Cooked, UpToDate, Raw, Failed };
+	Result cookFile(const std::string& name, std::string* storedPath);
+
+	void listFiles(const std::string& directory, std::vector<std::string>* names) const;
+	bool createDirectories(const std::string& path) const;
+
+protected:
+	std::string m_sourceDir;
+	std::string m_cacheDir;
+};